@@ -0,0 +1,52 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+struct Batch
+{
+	Batch():first(-1), last(-1), step(-1), priority(0), weight(1), id(-1), next(-1), done(0), total(0), bytes(0), errors(0)
+	{
+	}
+
+	QString url;
+	QString referer;
+	int first;
+	int last;
+	int step;
+	QString directory;
+	QStringList mirrors; // other URLs of the same files, with the same mask
+	int priority; // highest first
+	int weight; // share with batches of same priority
+	int id; // in download manager, -1 if not queued
+	int next; // next number to queue
+
+	// status while downloading
+	int done;
+	int total;
+	qint64 bytes;
+	int errors;
+};
+
+typedef QVector<Batch> Batches;
+
+Q_DECLARE_METATYPE(Batches)
+
+#endif
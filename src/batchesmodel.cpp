@@ -0,0 +1,331 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "batchesmodel.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// views are refreshed at most every 200 ms
+#define REFRESH_INTERVAL 200
+
+BatchesModel::BatchesModel(QObject* parent):QAbstractTableModel(parent), m_firstChanged(-1), m_lastChanged(-1)
+{
+	m_timer = new QTimer(this);
+	m_timer->setSingleShot(true);
+	m_timer->setInterval(REFRESH_INTERVAL);
+	connect(m_timer, &QTimer::timeout, this, &BatchesModel::onRefresh);
+}
+
+BatchesModel::~BatchesModel()
+{
+}
+
+int BatchesModel::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : m_rows.size();
+}
+
+int BatchesModel::columnCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant BatchesModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || index.row() >= m_rows.size()) return QVariant();
+
+	const Row& batch = m_rows[index.row()];
+
+	if (role == Qt::DisplayRole)
+	{
+		switch (index.column())
+		{
+		case ColumnUrl:
+			return m_strings[batch.url];
+
+		case ColumnProgress:
+			if (batch.total == 0) return QVariant();
+
+			return QString("%1 / %2").arg(batch.done).arg(batch.total);
+
+		case ColumnSize:
+			if (batch.bytes == 0) return QVariant();
+
+			return QLocale().formattedDataSize(batch.bytes);
+
+		case ColumnErrors:
+			if (batch.errors == 0) return QVariant();
+
+			return batch.errors;
+
+		default:
+			break;
+		}
+	}
+	else if (role == Qt::ToolTipRole && index.column() == ColumnUrl)
+	{
+		return m_strings[batch.url];
+	}
+
+	return QVariant();
+}
+
+QVariant BatchesModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+
+	switch (section)
+	{
+	case ColumnUrl:
+		return tr("URL");
+
+	case ColumnProgress:
+		return tr("Progress");
+
+	case ColumnSize:
+		return tr("Size");
+
+	case ColumnErrors:
+		return tr("Errors");
+
+	default:
+		break;
+	}
+
+	return QVariant();
+}
+
+bool BatchesModel::isEmpty() const
+{
+	return m_rows.isEmpty();
+}
+
+int BatchesModel::size() const
+{
+	return m_rows.size();
+}
+
+Batch BatchesModel::batch(int row) const
+{
+	const Row& r = m_rows[row];
+
+	Batch batch;
+	batch.url = m_strings[r.url];
+	batch.referer = m_strings[r.referer];
+	batch.directory = m_strings[r.directory];
+	batch.mirrors = m_mirrors[r.mirrors];
+	batch.first = r.first;
+	batch.last = r.last;
+	batch.step = r.step;
+	batch.priority = r.priority;
+	batch.weight = r.weight;
+	batch.id = r.id;
+	batch.next = r.next;
+	batch.done = r.done;
+	batch.total = r.total;
+	batch.bytes = r.bytes;
+	batch.errors = r.errors;
+
+	return batch;
+}
+
+QString BatchesModel::url(int row) const
+{
+	return m_strings[m_rows[row].url];
+}
+
+void BatchesModel::setId(int row, int id)
+{
+	m_rows[row].id = id;
+}
+
+void BatchesModel::setNext(int row, int next)
+{
+	m_rows[row].next = next;
+}
+
+bool BatchesModel::rowIdLessThan(const Row& row, int id)
+{
+	// batches not queued are considered after all others
+	return row.id > -1 && row.id < id;
+}
+
+int BatchesModel::rowFromId(int id) const
+{
+	if (id < 0) return -1;
+
+	// batches are queued in the order of the list so IDs are sorted
+	QVector<Row>::const_iterator it = std::lower_bound(m_rows.constBegin(), m_rows.constEnd(), id, rowIdLessThan);
+
+	if (it == m_rows.constEnd() || it->id != id) return -1;
+
+	return it - m_rows.constBegin();
+}
+
+int BatchesModel::stringIndex(const QString& str)
+{
+	QHash<QString, int>::const_iterator it = m_stringIndices.constFind(str);
+
+	if (it != m_stringIndices.constEnd()) return it.value();
+
+	m_strings << str;
+	m_stringIndices[str] = m_strings.size() - 1;
+
+	return m_strings.size() - 1;
+}
+
+int BatchesModel::mirrorsIndex(const QStringList& mirrors)
+{
+	// URLs can't contain line breaks
+	QString key = mirrors.join('\n');
+
+	QHash<QString, int>::const_iterator it = m_mirrorsIndices.constFind(key);
+
+	if (it != m_mirrorsIndices.constEnd()) return it.value();
+
+	m_mirrors << mirrors;
+	m_mirrorsIndices[key] = m_mirrors.size() - 1;
+
+	return m_mirrors.size() - 1;
+}
+
+void BatchesModel::append(const Batches& batches)
+{
+	if (batches.isEmpty()) return;
+
+	beginInsertRows(QModelIndex(), m_rows.size(), m_rows.size() + batches.size() - 1);
+
+	m_rows.reserve(m_rows.size() + batches.size());
+
+	for (const Batch& batch : batches)
+	{
+		Row row;
+		row.url = stringIndex(batch.url);
+		row.referer = stringIndex(batch.referer);
+		row.directory = stringIndex(batch.directory);
+		row.mirrors = mirrorsIndex(batch.mirrors);
+		row.first = batch.first;
+		row.last = batch.last;
+		row.step = batch.step;
+		row.priority = batch.priority;
+		row.weight = batch.weight;
+		row.id = batch.id;
+		row.next = batch.next;
+		row.done = batch.done;
+		row.total = batch.total;
+		row.bytes = batch.bytes;
+		row.errors = batch.errors;
+
+		m_rows << row;
+	}
+
+	endInsertRows();
+}
+
+void BatchesModel::remove(int row)
+{
+	beginRemoveRows(QModelIndex(), row, row);
+
+	m_rows.remove(row);
+
+	endRemoveRows();
+
+	// changed rows are shifted
+	if (m_firstChanged > row) --m_firstChanged;
+	if (m_lastChanged >= row) --m_lastChanged;
+
+	if (m_lastChanged < m_firstChanged)
+	{
+		m_firstChanged = -1;
+		m_lastChanged = -1;
+	}
+}
+
+void BatchesModel::clear()
+{
+	beginResetModel();
+
+	m_rows.clear();
+
+	m_strings.clear();
+	m_stringIndices.clear();
+	m_mirrors.clear();
+	m_mirrorsIndices.clear();
+
+	m_firstChanged = -1;
+	m_lastChanged = -1;
+
+	endResetModel();
+}
+
+void BatchesModel::setProgress(int id, int done, int total)
+{
+	int row = rowFromId(id);
+
+	if (row < 0) return;
+
+	m_rows[row].done = done;
+	m_rows[row].total = total;
+
+	invalidate(row);
+}
+
+void BatchesModel::addBytes(int id, qint64 bytes)
+{
+	int row = rowFromId(id);
+
+	if (row < 0) return;
+
+	m_rows[row].bytes += bytes;
+
+	invalidate(row);
+}
+
+void BatchesModel::addError(int id)
+{
+	int row = rowFromId(id);
+
+	if (row < 0) return;
+
+	++m_rows[row].errors;
+
+	invalidate(row);
+}
+
+void BatchesModel::invalidate(int row)
+{
+	if (m_firstChanged < 0 || row < m_firstChanged) m_firstChanged = row;
+	if (row > m_lastChanged) m_lastChanged = row;
+
+	if (!m_timer->isActive()) m_timer->start();
+}
+
+void BatchesModel::onRefresh()
+{
+	if (m_firstChanged < 0) return;
+
+	// only status columns can change
+	emit dataChanged(index(m_firstChanged, ColumnProgress), index(m_lastChanged, ColumnErrors));
+
+	m_firstChanged = -1;
+	m_lastChanged = -1;
+}
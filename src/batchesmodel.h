@@ -0,0 +1,120 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHESMODEL_H
+#define BATCHESMODEL_H
+
+#include "batch.h"
+
+// list of batches with their status, texts are only built when displayed and
+// status changes are notified to views periodically in a single range
+// batches are stored in compact rows, strings shared by several batches (referer,
+// directory, mirrors, etc...) are only stored once
+class BatchesModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	enum Column
+	{
+		ColumnUrl,
+		ColumnProgress,
+		ColumnSize,
+		ColumnErrors,
+		ColumnCount
+	};
+
+	BatchesModel(QObject* parent);
+	virtual ~BatchesModel();
+
+	virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+	bool isEmpty() const;
+	int size() const;
+
+	// full batch is only created when needed
+	Batch batch(int row) const;
+	QString url(int row) const;
+
+	void setId(int row, int id);
+	void setNext(int row, int next);
+
+	// row of a queued batch, -1 if not found
+	int rowFromId(int id) const;
+
+	void append(const Batches& batches);
+	void remove(int row);
+	void clear();
+
+	// status while downloading
+	void setProgress(int id, int done, int total);
+	void addBytes(int id, qint64 bytes);
+	void addError(int id);
+
+private slots:
+	void onRefresh();
+
+private:
+	// fields of a batch, strings are indices in m_strings and m_mirrors
+	struct Row
+	{
+		int url;
+		int referer;
+		int directory;
+		int mirrors;
+		int first;
+		int last;
+		int step;
+		int priority;
+		int weight;
+		int id;
+		int next;
+
+		int done;
+		int total;
+		qint64 bytes;
+		int errors;
+	};
+
+	static bool rowIdLessThan(const Row& row, int id);
+
+	int stringIndex(const QString& str);
+	int mirrorsIndex(const QStringList& mirrors);
+
+	void invalidate(int row);
+
+	QVector<Row> m_rows;
+
+	// only released when model is cleared
+	QVector<QString> m_strings;
+	QHash<QString, int> m_stringIndices;
+	QVector<QStringList> m_mirrors;
+	QHash<QString, int> m_mirrorsIndices;
+
+	// rows changed since last refresh
+	int m_firstChanged;
+	int m_lastChanged;
+
+	QTimer *m_timer;
+};
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "benchmark.h"
+#include "functions.h"
+#include "benchmarkserver.h"
+#include "downloadmanager.h"
+#include "downloadentry.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// number of URLs generated when no corpus is provided
+#define GENERATED_URLS 10000
+
+// each helper is called on the whole corpus during at least this time
+#define MIN_DURATION 500
+
+// files downloaded by tiny scenario
+#define TINY_FILES 10000
+#define TINY_FILE_SIZE 2048
+
+// files downloaded by huge scenario
+#define HUGE_FILES 10
+#define HUGE_FILE_SIZE (100 * 1024 * 1024)
+
+// files downloaded by mixed scenario
+#define MIXED_FILES 1000
+#define MEDIUM_FILE_SIZE (1024 * 1024)
+
+typedef int (*HelperFunction)(const QString& url);
+
+struct Helper
+{
+	const char *name;
+	HelperFunction function;
+};
+
+// return a value depending on result so calls are not optimized out
+
+static int benchmarkStripParameters(const QString& url)
+{
+	return stripParameters(url).length();
+}
+
+static int benchmarkGetFilenameFromUrl(const QString& url)
+{
+	return getFilenameFromUrl(url).length();
+}
+
+static int benchmarkParseUrl(const QString& url)
+{
+	QString basename, ext;
+
+	return parseUrl(url, &basename, &ext) ? basename.length() + ext.length() : 0;
+}
+
+static int benchmarkGetChecksumFromUrl(const QString& url)
+{
+	return getChecksumFromUrl(url).length();
+}
+
+static int benchmarkFixFilename(const QString& url)
+{
+	return fixFilename(url).length();
+}
+
+static int benchmarkMakeFilenameFromUrl(const QString& url)
+{
+	return makeFilenameFromUrl(url, "12345").length();
+}
+
+static const Helper s_helpers[] =
+{
+	{ "stripParameters", benchmarkStripParameters },
+	{ "getFilenameFromUrl", benchmarkGetFilenameFromUrl },
+	{ "parseUrl", benchmarkParseUrl },
+	{ "getChecksumFromUrl", benchmarkGetChecksumFromUrl },
+	{ "fixFilename", benchmarkFixFilename },
+	{ "makeFilenameFromUrl", benchmarkMakeFilenameFromUrl },
+	{ nullptr, nullptr }
+};
+
+static QStringList generateCorpus()
+{
+	QStringList urls;
+	urls.reserve(GENERATED_URLS);
+
+	for (int i = 0; i < GENERATED_URLS; ++i)
+	{
+		QString md5 = QString::fromLatin1(QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Md5).toHex());
+
+		// same proportions of URLs with a checksum, with parameters, with special characters and without filename
+		switch (i % 4)
+		{
+			case 0:
+			urls << QString("https://c10.patreonusercontent.com/3/eyJwIjoxfQ%3D%3D/patreon-media/p/post/%1/%2/1.jpg?token-time=%3&token-hash=%4").arg(40000000 + i).arg(md5).arg(1600000000 + i).arg(md5.left(16));
+			break;
+
+			case 1:
+			urls << QString("https://www.example.com/gallery/%1/image_%2.png").arg(i / 100).arg(i, 6, 10, QChar('0'));
+			break;
+
+			case 2:
+			urls << QString::fromUtf8("https://cdn.example.org/files/%1/Chapitre \xc3\xa9t\xc3\xa9 : partie %2 | \"final\"....mp4?download=1").arg(md5.left(8)).arg(i);
+			break;
+
+			default:
+			urls << QString("https://example.net/download?id=%1&format=raw").arg(i);
+			break;
+		}
+	}
+
+	return urls;
+}
+
+static QStringList loadCorpus(const QString& filename)
+{
+	QStringList urls;
+
+	QFile file(filename);
+
+	if (!file.open(QFile::ReadOnly | QFile::Text)) return urls;
+
+	while (!file.atEnd())
+	{
+		QString url = QString::fromUtf8(file.readLine()).trimmed();
+
+		if (!url.isEmpty()) urls << url;
+	}
+
+	return urls;
+}
+
+static QHash<QString, double> loadBaseline(const QString& filename)
+{
+	QHash<QString, double> results;
+
+	QFile file(filename);
+
+	if (!file.open(QFile::ReadOnly | QFile::Text)) return results;
+
+	while (!file.atEnd())
+	{
+		// name and nanoseconds per call separated by a space
+		QStringList fields = QString::fromUtf8(file.readLine()).trimmed().split(' ');
+
+		if (fields.size() == 2) results[fields[0]] = fields[1].toDouble();
+	}
+
+	return results;
+}
+
+static bool saveBaseline(const QString& filename, const QVector<QPair<QString, double> >& results)
+{
+	QFile file(filename);
+
+	if (!file.open(QFile::WriteOnly | QFile::Text | QFile::Truncate)) return false;
+
+	for (const QPair<QString, double>& result : results)
+	{
+		file.write(QString("%1 %2\n").arg(result.first).arg(result.second, 0, 'f', 1).toUtf8());
+	}
+
+	return true;
+}
+
+int benchmarkHelpers(const QString& corpus, const QString& baseline)
+{
+	QTextStream out(stdout);
+
+	QStringList urls = corpus.isEmpty() ? generateCorpus() : loadCorpus(corpus);
+
+	if (urls.isEmpty())
+	{
+		out << "No URL in " << corpus << Qt::endl;
+		return 1;
+	}
+
+	QHash<QString, double> previous = loadBaseline(baseline);
+	QVector<QPair<QString, double> > results;
+
+	out << urls.size() << " URLs" << Qt::endl;
+
+	qint64 sink = 0;
+
+	for (const Helper* helper = s_helpers; helper->name; ++helper)
+	{
+		// warm up caches and allocators
+		for (const QString& url : urls) sink += helper->function(url);
+
+		qint64 calls = 0;
+
+		QElapsedTimer timer;
+		timer.start();
+
+		do
+		{
+			for (const QString& url : urls) sink += helper->function(url);
+
+			calls += urls.size();
+		}
+		while (timer.elapsed() < MIN_DURATION);
+
+		double nsPerCall = (double)timer.nsecsElapsed() / (double)calls;
+
+		results << qMakePair(QString(helper->name), nsPerCall);
+
+		out << QString("%1 %2 ns/call").arg(helper->name, -20).arg(nsPerCall, 10, 'f', 1);
+
+		if (previous.contains(helper->name) && previous[helper->name] > 0.0)
+		{
+			out << QString(" (%1%)").arg((nsPerCall / previous[helper->name] - 1.0) * 100.0, 0, 'f', 1);
+		}
+
+		out << Qt::endl;
+	}
+
+	// keep first results as reference
+	if (!baseline.isEmpty() && !QFile::exists(baseline) && !saveBaseline(baseline, results))
+	{
+		out << "Unable to save " << baseline << Qt::endl;
+	}
+
+	// sink is never 0, only used to keep calls
+	return sink == 0 ? 1 : 0;
+}
+
+static void queueDownload(DownloadManager& manager, const QString& url, const QString& directory, const QString& filename, DownloadEntry::Method method, const QStringList& mirrors = QStringList())
+{
+	DownloadEntry entry;
+	entry.url = url;
+	entry.filename = filename;
+	entry.method = method;
+	entry.mirrors = mirrors;
+
+	// pages are only kept in memory
+	if (!filename.isEmpty()) entry.fullPath = directory + "/" + filename;
+
+	manager.addToQueue(entry);
+}
+
+static void queueMixed(DownloadManager& manager, const QString& server, const QString& directory)
+{
+	for (int i = 0; i < MIXED_FILES; ++i)
+	{
+		QString filename = QString("mixed%1.bin").arg(i);
+		QString medium = QString("%1/%2").arg(MEDIUM_FILE_SIZE).arg(filename);
+
+		switch (i % 10)
+		{
+			case 0:
+			queueDownload(manager, QString("%1/redirect/file/%2/%3").arg(server).arg(TINY_FILE_SIZE).arg(filename), directory, filename, DownloadEntry::Method::Get);
+			break;
+
+			case 1:
+			queueDownload(manager, QString("%1/gzip/%2/page%3.html").arg(server).arg(TINY_FILE_SIZE * 4).arg(i), directory, QString(), DownloadEntry::Method::Get);
+			break;
+
+			case 2:
+			// 429 then next mirror
+			queueDownload(manager, QString("%1/busy/%2/%3").arg(server).arg(TINY_FILE_SIZE).arg(filename), directory, filename, DownloadEntry::Method::Get, QStringList() << QString("%1/file/%2/%3").arg(server).arg(TINY_FILE_SIZE).arg(filename));
+			break;
+
+			case 3:
+			// reset in the middle of body then next mirror
+			queueDownload(manager, server + "/reset/" + medium, directory, filename, DownloadEntry::Method::Head, QStringList() << server + "/file/" + medium);
+			break;
+
+			case 4:
+			// slow servers are rare
+			queueDownload(manager, (i % 100 == 4 ? server + "/trickle/" : server + "/file/") + medium, directory, filename, DownloadEntry::Method::Head);
+			break;
+
+			case 5:
+			{
+				// half already downloaded, resumed with a Range
+				QFile file(directory + "/" + filename);
+
+				if (file.open(QFile::WriteOnly)) file.write(BenchmarkServer::content(0, MEDIUM_FILE_SIZE / 2));
+			}
+
+			queueDownload(manager, server + "/file/" + medium, directory, filename, DownloadEntry::Method::Head);
+			break;
+
+			case 6:
+			queueDownload(manager, server + "/file/" + medium, directory, filename, DownloadEntry::Method::Head);
+			break;
+
+			default:
+			queueDownload(manager, QString("%1/file/%2/%3").arg(server).arg(TINY_FILE_SIZE).arg(filename), directory, filename, DownloadEntry::Method::Get);
+			break;
+		}
+	}
+}
+
+int benchmarkDownloads(const QString& scenario)
+{
+	QTextStream out(stdout);
+
+	QTemporaryDir directory;
+
+	if (!directory.isValid())
+	{
+		out << "Unable to create a temporary directory" << Qt::endl;
+		return 1;
+	}
+
+	BenchmarkServer server(nullptr);
+
+	if (!server.start())
+	{
+		out << "Unable to listen on a local port: " << server.errorString() << Qt::endl;
+		return 1;
+	}
+
+	DownloadManager manager(nullptr);
+
+	int expected = 0;
+
+	// failures are part of the scenarios, only one host to resolve
+	manager.setStopOnError(false);
+	manager.setPrefetchHosts(false);
+
+	if (scenario == "tiny")
+	{
+		expected = TINY_FILES;
+
+		for (int i = 0; i < TINY_FILES; ++i)
+		{
+			QString filename = QString("tiny%1.bin").arg(i);
+
+			queueDownload(manager, QString("%1/file/%2/%3").arg(server.url()).arg(TINY_FILE_SIZE).arg(filename), directory.path(), filename, DownloadEntry::Method::Get);
+		}
+	}
+	else if (scenario == "huge")
+	{
+		expected = HUGE_FILES;
+
+		for (int i = 0; i < HUGE_FILES; ++i)
+		{
+			QString filename = QString("huge%1.bin").arg(i);
+
+			queueDownload(manager, QString("%1/file/%2/%3").arg(server.url()).arg(HUGE_FILE_SIZE).arg(filename), directory.path(), filename, DownloadEntry::Method::Head);
+		}
+	}
+	else if (scenario == "mixed")
+	{
+		expected = MIXED_FILES;
+
+		queueMixed(manager, server.url(), directory.path());
+	}
+	else
+	{
+		out << "Unknown scenario " << scenario << ", use tiny, huge or mixed" << Qt::endl;
+		return 1;
+	}
+
+	int errors = 0;
+
+	// retries and mirrors are not errors
+	QObject::connect(&manager, &DownloadManager::downloadFailed, [&errors](const DownloadEvent& entry)
+	{
+		Q_UNUSED(entry);
+
+		++errors;
+	});
+
+	QEventLoop loop;
+
+	QObject::connect(&manager, &DownloadManager::queueFinished, &loop, &QEventLoop::quit);
+
+	QTimer::singleShot(0, &manager, &DownloadManager::start);
+
+	loop.exec();
+
+	DownloadStatistics statistics = manager.statistics();
+
+	// server runs in the same process, its CPU time is included
+	double seconds = qMax(statistics.elapsed, (qint64)1) / 1000.0;
+	double megabytes = (double)statistics.bytes / (1024.0 * 1024.0);
+	double gigabytes = megabytes / 1024.0;
+
+	out << QString("%1: %2 files (%3 errors), %4 MiB in %5 s").arg(scenario).arg(statistics.files).arg(errors).arg(megabytes, 0, 'f', 1).arg(seconds, 0, 'f', 2) << Qt::endl;
+	out << QString("%1 files/s").arg(statistics.files / seconds, 0, 'f', 1) << Qt::endl;
+	out << QString("%1 MiB/s").arg(megabytes / seconds, 0, 'f', 1) << Qt::endl;
+
+	if (gigabytes > 0.0) out << QString("%1 CPU s/GiB").arg(statistics.cpuTime / 1000.0 / gigabytes, 0, 'f', 2) << Qt::endl;
+
+	out << QString("%1 MiB peak RSS").arg((double)statistics.peakMemory / (1024.0 * 1024.0), 0, 'f', 1) << Qt::endl;
+
+	// measures of an incomplete run can't be compared
+	if (errors > 0 || statistics.files < expected)
+	{
+		out << QString("%1 files expected").arg(expected) << Qt::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// measure helpers of functions.cpp called for each queued URL, corpus is a
+// text file with one URL per line (generated if empty), results are compared
+// with baseline file which is created if it doesn't exist yet
+int benchmarkHelpers(const QString& corpus, const QString& baseline);
+
+// download files served by a local HTTP server, scenario is tiny (many small
+// files), huge (few big files) or mixed (redirects, gzip, trickle, resets,
+// 429, resumes and mirrors), each one should be run in its own process
+// because peak memory is measured since process start
+int benchmarkDownloads(const QString& scenario);
+
+#endif
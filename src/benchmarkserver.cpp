@@ -0,0 +1,380 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "benchmarkserver.h"
+
+#include <zlib.h>
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// more data are written to a socket only when less are waiting
+#define MAX_SOCKET_BUFFER (256 * 1024)
+
+// body is the alphabet repeated
+#define PATTERN_SIZE 26
+
+// trickle connections receive this number of bytes at each tick
+#define TRICKLE_SIZE 1024
+
+// in ms
+#define TRICKLE_INTERVAL 10
+
+static QByteArray createPattern()
+{
+	QByteArray pattern(MAX_SOCKET_BUFFER + PATTERN_SIZE, Qt::Uninitialized);
+
+	for (int i = 0; i < pattern.size(); ++i) pattern[i] = 'a' + (i % PATTERN_SIZE);
+
+	return pattern;
+}
+
+// any part of body can be sent without generating it
+static const char* pattern(qint64 offset)
+{
+	static const QByteArray s_pattern = createPattern();
+
+	return s_pattern.constData() + (offset % PATTERN_SIZE);
+}
+
+static QByteArray gCompress(const QByteArray& data)
+{
+	QByteArray result;
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+
+	// gzip encoding
+	if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return result;
+
+	result.resize(deflateBound(&strm, data.size()));
+
+	strm.avail_in = data.size();
+	strm.next_in = (Bytef*)(data.data());
+	strm.avail_out = result.size();
+	strm.next_out = (Bytef*)(result.data());
+
+	int ret = deflate(&strm, Z_FINISH);
+
+	result.resize(ret == Z_STREAM_END ? result.size() - strm.avail_out : 0);
+
+	deflateEnd(&strm);
+
+	return result;
+}
+
+BenchmarkServer::BenchmarkServer(QObject* parent) : QTcpServer(parent)
+{
+	m_trickleTimer = new QTimer(this);
+	m_trickleTimer->setInterval(TRICKLE_INTERVAL);
+
+	connect(m_trickleTimer, &QTimer::timeout, this, &BenchmarkServer::onTrickle);
+	connect(this, &QTcpServer::newConnection, this, &BenchmarkServer::onNewConnection);
+}
+
+BenchmarkServer::~BenchmarkServer()
+{
+}
+
+bool BenchmarkServer::start()
+{
+	return listen(QHostAddress::LocalHost, 0);
+}
+
+QString BenchmarkServer::url() const
+{
+	return QString("http://127.0.0.1:%1").arg(serverPort());
+}
+
+QByteArray BenchmarkServer::content(qint64 offset, qint64 size)
+{
+	QByteArray data;
+	data.reserve(size);
+
+	while (data.size() < size)
+	{
+		int len = qMin(size - data.size(), (qint64)MAX_SOCKET_BUFFER);
+
+		data.append(pattern(offset + data.size()), len);
+	}
+
+	return data;
+}
+
+void BenchmarkServer::onNewConnection()
+{
+	while (QTcpSocket* socket = nextPendingConnection())
+	{
+		Connection& connection = m_connections[socket];
+		connection.offset = 0;
+		connection.end = 0;
+		connection.reset = -1;
+		connection.trickle = false;
+
+		connect(socket, &QTcpSocket::readyRead, this, &BenchmarkServer::onReadyRead);
+		connect(socket, &QTcpSocket::bytesWritten, this, &BenchmarkServer::onBytesWritten);
+		connect(socket, &QTcpSocket::disconnected, this, &BenchmarkServer::onDisconnected);
+	}
+}
+
+void BenchmarkServer::onReadyRead()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+
+	if (!socket || !m_connections.contains(socket)) return;
+
+	m_connections[socket].request += socket->readAll();
+
+	processRequests(socket);
+}
+
+void BenchmarkServer::onBytesWritten()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+
+	if (!socket || !m_connections.contains(socket)) return;
+
+	Connection& connection = m_connections[socket];
+
+	// trickle connections are only processed by timer
+	if (connection.trickle) return;
+
+	if (sendBody(socket, connection)) processRequests(socket);
+}
+
+void BenchmarkServer::onDisconnected()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+
+	if (!socket) return;
+
+	m_connections.remove(socket);
+
+	socket->deleteLater();
+}
+
+void BenchmarkServer::onTrickle()
+{
+	bool trickling = false;
+
+	// connections can be removed while sending
+	const QList<QTcpSocket*> sockets = m_connections.keys();
+
+	for (QTcpSocket* socket : sockets)
+	{
+		if (!m_connections.contains(socket)) continue;
+
+		Connection& connection = m_connections[socket];
+
+		if (!connection.trickle) continue;
+
+		if (sendBody(socket, connection))
+		{
+			// body completely sent
+			if (connection.offset >= connection.end)
+			{
+				connection.trickle = false;
+
+				processRequests(socket);
+			}
+		}
+
+		if (m_connections.contains(socket) && m_connections[socket].trickle) trickling = true;
+	}
+
+	if (!trickling) m_trickleTimer->stop();
+}
+
+void BenchmarkServer::processRequests(QTcpSocket* socket)
+{
+	while (m_connections.contains(socket))
+	{
+		Connection& connection = m_connections[socket];
+
+		// wait until previous body is sent
+		if (connection.offset < connection.end) return;
+
+		int pos = connection.request.indexOf("\r\n\r\n");
+
+		if (pos < 0)
+		{
+			// not an HTTP client
+			if (connection.request.size() > 8192) socket->abort();
+
+			return;
+		}
+
+		// requests sent by benchmarks have no body
+		QByteArray header = connection.request.left(pos);
+		connection.request.remove(0, pos + 4);
+
+		if (!processRequest(socket, connection, header)) return;
+	}
+}
+
+bool BenchmarkServer::processRequest(QTcpSocket* socket, Connection& connection, const QByteArray& header)
+{
+	QList<QByteArray> lines = header.split('\n');
+	QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+
+	if (requestLine.size() < 2)
+	{
+		socket->abort();
+
+		return false;
+	}
+
+	bool head = requestLine[0] == "HEAD";
+	QString path = QString::fromLatin1(requestLine[1]);
+	QByteArray range;
+
+	for (const QByteArray& line : lines)
+	{
+		if (line.toLower().startsWith("range:")) range = line.mid(6).trimmed();
+	}
+
+	QStringList parts = path.split('/', Qt::SkipEmptyParts);
+
+	if (parts.size() > 1 && parts[0] == "redirect")
+	{
+		socket->write("HTTP/1.1 302 Found\r\nLocation: " + (url() + path.mid(9)).toLatin1() + "\r\nContent-Length: 0\r\n\r\n");
+
+		return true;
+	}
+
+	if (parts.size() < 3)
+	{
+		socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+
+		return true;
+	}
+
+	QString kind = parts[0];
+	qint64 size = parts[1].toLongLong();
+
+	// only first request is refused, client is expected to retry or use a mirror
+	if (kind == "busy" && !m_failed.contains(path))
+	{
+		m_failed.insert(path);
+
+		socket->write("HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nContent-Length: 0\r\n\r\n");
+
+		return true;
+	}
+
+	if (kind == "gzip")
+	{
+		QByteArray body = gCompress(content(0, size));
+
+		socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\n\r\n");
+
+		if (!head) socket->write(body);
+
+		return true;
+	}
+
+	qint64 first = 0, last = size - 1;
+	bool partial = false;
+
+	if (range.startsWith("bytes="))
+	{
+		QList<QByteArray> bounds = range.mid(6).split('-');
+
+		first = bounds[0].toLongLong();
+
+		if (bounds.size() > 1 && !bounds[1].isEmpty()) last = qMin(bounds[1].toLongLong(), size - 1);
+
+		partial = true;
+	}
+
+	if (first > last)
+	{
+		socket->write("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + QByteArray::number(size) + "\r\nContent-Length: 0\r\n\r\n");
+
+		return true;
+	}
+
+	QByteArray response = partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+	response += "Content-Type: application/octet-stream\r\n";
+	response += "Accept-Ranges: bytes\r\n";
+	response += "Last-Modified: Sat, 01 Jan 2022 00:00:00 GMT\r\n";
+	response += "Content-Length: " + QByteArray::number(last - first + 1) + "\r\n";
+
+	if (partial) response += "Content-Range: bytes " + QByteArray::number(first) + "-" + QByteArray::number(last) + "/" + QByteArray::number(size) + "\r\n";
+
+	response += "\r\n";
+
+	socket->write(response);
+
+	if (head) return true;
+
+	connection.offset = first;
+	connection.end = last + 1;
+	connection.reset = -1;
+	connection.trickle = kind == "trickle";
+
+	// only first download is reset, a resumed one succeeds
+	if (kind == "reset" && !partial && !m_failed.contains(path))
+	{
+		m_failed.insert(path);
+
+		connection.reset = first + (last - first + 1) / 2;
+	}
+
+	if (connection.trickle)
+	{
+		m_trickleTimer->start();
+
+		return true;
+	}
+
+	return sendBody(socket, connection);
+}
+
+bool BenchmarkServer::sendBody(QTcpSocket* socket, Connection& connection)
+{
+	while (connection.offset < connection.end && socket->bytesToWrite() < MAX_SOCKET_BUFFER)
+	{
+		// simulate a connection reset by peer in the middle of body
+		if (connection.offset == connection.reset)
+		{
+			m_connections.remove(socket);
+
+			socket->abort();
+			socket->deleteLater();
+
+			return false;
+		}
+
+		qint64 size = qMin(connection.end - connection.offset, connection.trickle ? (qint64)TRICKLE_SIZE : (qint64)MAX_SOCKET_BUFFER);
+
+		if (connection.reset > connection.offset) size = qMin(size, connection.reset - connection.offset);
+
+		socket->write(pattern(connection.offset), size);
+
+		connection.offset += size;
+
+		// next part at next tick
+		if (connection.trickle) break;
+	}
+
+	return true;
+}
@@ -0,0 +1,74 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BENCHMARKSERVER_H
+#define BENCHMARKSERVER_H
+
+// loopback HTTP server used by benchmarks, path is /<kind>/<size>/<name>
+// with kind:
+// - file: HEAD, GET and Range requests (206)
+// - trickle: body is sent slowly
+// - reset: first GET without Range is reset in the middle of body
+// - busy: first request is answered with 429
+// - gzip: whole body is compressed with gzip
+// and /redirect/<path> is redirected to /<path>
+class BenchmarkServer : public QTcpServer
+{
+	Q_OBJECT
+
+public:
+	BenchmarkServer(QObject* parent);
+	virtual ~BenchmarkServer();
+
+	// listen on a random local port
+	bool start();
+
+	// prefix of all paths
+	QString url() const;
+
+	// part of body returned for any path
+	static QByteArray content(qint64 offset, qint64 size);
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onBytesWritten();
+	void onDisconnected();
+	void onTrickle();
+
+private:
+	struct Connection
+	{
+		QByteArray request; // received data not processed yet
+		qint64 offset; // position of next byte of body to send
+		qint64 end; // position after last byte of body
+		qint64 reset; // position where connection is reset, -1 if never
+		bool trickle; // body is sent by timer
+	};
+
+	void processRequests(QTcpSocket* socket);
+	bool processRequest(QTcpSocket* socket, Connection& connection, const QByteArray& header);
+	bool sendBody(QTcpSocket* socket, Connection& connection);
+
+	QHash<QTcpSocket*, Connection> m_connections;
+	QSet<QString> m_failed; // paths already reset or answered with 429
+	QTimer *m_trickleTimer;
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "contentstore.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+ContentStore::ContentStore()
+{
+}
+
+ContentStore::~ContentStore()
+{
+	close();
+}
+
+bool ContentStore::open(const QString& filename)
+{
+	close();
+
+	m_file.setFileName(filename);
+
+	// create directory if not exists
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	if (!m_file.open(QFile::ReadWrite | QFile::Append)) return false;
+
+	m_file.seek(0);
+
+	// each line is "<key>\t<size>\t<modification time>\t<path>", last occurrence of a key wins
+	while (!m_file.atEnd())
+	{
+		QList<QByteArray> fields = m_file.readLine().trimmed().split('\t');
+
+		// lines without size and time can't be checked
+		if (fields.size() < 4 || fields[0].isEmpty()) continue;
+
+		Content content;
+
+		bool sizeOk = false, timeOk = false;
+
+		content.size = fields[1].toLongLong(&sizeOk);
+		content.time = fields[2].toLongLong(&timeOk);
+
+		if (!sizeOk || !timeOk) continue;
+
+		// path could contain tabulations
+		content.path = QString::fromUtf8(fields.mid(3).join('\t'));
+
+		m_contents[QString::fromLatin1(fields[0])] = content;
+	}
+
+	return true;
+}
+
+void ContentStore::close()
+{
+	if (m_file.isOpen()) m_file.close();
+
+	m_contents.clear();
+}
+
+bool ContentStore::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+QString ContentStore::find(const QString& key)
+{
+	QHash<QString, Content>::iterator it = m_contents.find(key);
+
+	if (it == m_contents.end()) return QString();
+
+	QString path = it.value().path;
+	QFileInfo info(path);
+
+	// file could have been deleted, moved, edited or replaced since
+	if (!info.exists() || info.size() != it.value().size || info.lastModified().toMSecsSinceEpoch() != it.value().time)
+	{
+		m_contents.erase(it);
+
+		return QString();
+	}
+
+	return path;
+}
+
+void ContentStore::insert(const QString& key, const QString& path)
+{
+	if (!m_file.isOpen()) return;
+
+	QFileInfo info(path);
+
+	if (!info.exists()) return;
+
+	Content content;
+	content.path = path;
+	content.size = info.size();
+	content.time = info.lastModified().toMSecsSinceEpoch();
+
+	QHash<QString, Content>::const_iterator it = m_contents.constFind(key);
+
+	// already up to date
+	if (it != m_contents.constEnd() && it.value().path == path && it.value().size == content.size && it.value().time == content.time) return;
+
+	m_contents[key] = content;
+
+	m_file.write(key.toLatin1() + "\t" + QByteArray::number(content.size) + "\t" + QByteArray::number(content.time) + "\t" + path.toUtf8() + "\n");
+	m_file.flush();
+}
+
+QString ContentStore::sha256Key(const QByteArray& sha256)
+{
+	return "sha256:" + QString::fromLatin1(sha256.toHex());
+}
+
+QString ContentStore::checksumKey(const QString& checksum)
+{
+	// only verified checksums, keys of previous versions were not
+	return "md5:" + checksum;
+}
@@ -0,0 +1,57 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+// index of already downloaded files by content (SHA-256) or by checksum found in URL
+class ContentStore
+{
+public:
+	ContentStore();
+	~ContentStore();
+
+	bool open(const QString& filename);
+	void close();
+
+	bool isOpen() const;
+
+	// return the path of a file with the same content or an empty string,
+	// entries of files modified since they were inserted are removed
+	QString find(const QString& key);
+
+	void insert(const QString& key, const QString& path);
+
+	static QString sha256Key(const QByteArray& sha256);
+	static QString checksumKey(const QString& checksum);
+
+private:
+	struct Content
+	{
+		QString path;
+		qint64 size;
+		qint64 time; // modification time in ms since epoch
+	};
+
+	QHash<QString, Content> m_contents;
+
+	QFile m_file;
+};
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "csvreader.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// number of batches sent at once to GUI thread
+#define BATCHES_PER_SIGNAL 1000
+
+CsvReader::CsvReader(const QString& filename, QObject* parent):QThread(parent), m_filename(filename)
+{
+	qRegisterMetaType<Batches>("Batches");
+}
+
+CsvReader::~CsvReader()
+{
+	requestInterruption();
+	wait();
+}
+
+bool CsvReader::readRow(const char*& p, const char* end, QByteArrayList& row)
+{
+	row.clear();
+
+	// skip empty lines
+	while (p < end && (*p == '\n' || *p == '\r')) ++p;
+
+	if (p >= end) return false;
+
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+
+	if (!eol) eol = end;
+
+	// fast path, no quotes in line so fields are only separated by commas
+	if (!memchr(p, '"', eol - p))
+	{
+		const char* lineEnd = eol;
+
+		if (lineEnd > p && lineEnd[-1] == '\r') --lineEnd;
+
+		for(;;)
+		{
+			const char* comma = static_cast<const char*>(memchr(p, ',', lineEnd - p));
+
+			if (!comma)
+			{
+				row << QByteArray(p, lineEnd - p);
+				break;
+			}
+
+			row << QByteArray(p, comma - p);
+
+			p = comma + 1;
+		}
+
+		p = eol < end ? eol + 1 : end;
+
+		return true;
+	}
+
+	// quoted fields can contain commas, line breaks and escaped quotes ("")
+	QByteArray value;
+	bool quoted = false;
+
+	while (p < end)
+	{
+		char c = *p++;
+
+		if (quoted)
+		{
+			if (c == '"')
+			{
+				if (p < end && *p == '"')
+				{
+					// escaped quote
+					value += '"';
+					++p;
+				}
+				else
+				{
+					quoted = false;
+				}
+			}
+			else
+			{
+				// copy all characters until next quote at once
+				const char* start = p - 1;
+				const char* quote = static_cast<const char*>(memchr(start, '"', end - start));
+
+				if (!quote) quote = end;
+
+				value.append(start, quote - start);
+
+				p = quote;
+			}
+		}
+		else if (c == '"')
+		{
+			quoted = true;
+		}
+		else if (c == ',')
+		{
+			row << value;
+
+			value.clear();
+		}
+		else if (c == '\n')
+		{
+			break;
+		}
+		else if (c != '\r')
+		{
+			value += c;
+		}
+	}
+
+	row << value;
+
+	return true;
+}
+
+void CsvReader::run()
+{
+	QFile file(m_filename);
+
+	if (!file.open(QFile::ReadOnly))
+	{
+		emit error(tr("Unable to open %1").arg(m_filename));
+		return;
+	}
+
+	qint64 size = file.size();
+
+	// don't need to copy the file in memory
+	const char* data = reinterpret_cast<const char*>(size > 0 ? file.map(0, size) : nullptr);
+
+	QByteArray buffer;
+
+	if (!data)
+	{
+		// mapping not supported
+		buffer = file.readAll();
+
+		data = buffer.constData();
+		size = buffer.size();
+	}
+
+	const char* p = data;
+	const char* end = data + size;
+
+	// skip UTF-8 BOM
+	if (size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+
+	// parse first row with headers
+	QByteArrayList headers;
+
+	if (!readRow(p, end, headers))
+	{
+		emit error(tr("No header found"));
+		return;
+	}
+
+	int urlIndex = -1;
+	int refererIndex = -1;
+	int directoryIndex = -1;
+	int firstIndex = -1;
+	int lastIndex = -1;
+	int stepIndex = -1;
+	int priorityIndex = -1;
+	int weightIndex = -1;
+	int mirrorsIndex = -1;
+
+	for (int i = 0, ilen = headers.size(); i < ilen; ++i)
+	{
+		QByteArray header = headers[i].trimmed();
+
+		if (header == "url")
+		{
+			urlIndex = i;
+		}
+		else if (header == "referer")
+		{
+			refererIndex = i;
+		}
+		else if (header == "directory")
+		{
+			directoryIndex = i;
+		}
+		else if (header == "first")
+		{
+			firstIndex = i;
+		}
+		else if (header == "last")
+		{
+			lastIndex = i;
+		}
+		else if (header == "step")
+		{
+			stepIndex = i;
+		}
+		else if (header == "priority")
+		{
+			priorityIndex = i;
+		}
+		else if (header == "weight")
+		{
+			weightIndex = i;
+		}
+		else if (header == "mirrors")
+		{
+			mirrorsIndex = i;
+		}
+		else
+		{
+			emit error(tr("Unknown field %1").arg(QString::fromUtf8(header)));
+			return;
+		}
+	}
+
+	if (urlIndex == -1)
+	{
+		emit error(tr("URL field is required"));
+		return;
+	}
+
+	Batches batches;
+	batches.reserve(BATCHES_PER_SIGNAL);
+
+	QByteArrayList row;
+	int rows = 0;
+
+	while (!isInterruptionRequested() && readRow(p, end, row))
+	{
+		++rows;
+
+		if (row.size() != headers.size())
+		{
+			emit error(tr("Wrong fields number in row %1").arg(rows));
+			break;
+		}
+
+		Batch batch;
+
+		batch.url = QString::fromUtf8(row[urlIndex].trimmed());
+
+		if (refererIndex > -1) batch.referer = QString::fromUtf8(row[refererIndex].trimmed());
+		if (directoryIndex > -1) batch.directory = QString::fromUtf8(row[directoryIndex].trimmed());
+
+		// URLs separated by spaces
+		if (mirrorsIndex > -1) batch.mirrors = QString::fromUtf8(row[mirrorsIndex]).split(' ', Qt::SkipEmptyParts);
+
+		batch.first = firstIndex > -1 ? row[firstIndex].toInt() : 1;
+		batch.last = lastIndex > -1 ? row[lastIndex].toInt() : 1;
+		batch.step = stepIndex > -1 ? row[stepIndex].toInt() : 1;
+		batch.priority = priorityIndex > -1 ? row[priorityIndex].toInt() : 0;
+		batch.weight = weightIndex > -1 ? row[weightIndex].toInt() : 1;
+
+		batches << batch;
+
+		// send them while parsing next ones
+		if (batches.size() >= BATCHES_PER_SIGNAL)
+		{
+			emit batchesRead(batches);
+
+			batches.clear();
+			batches.reserve(BATCHES_PER_SIGNAL);
+		}
+	}
+
+	if (!batches.isEmpty()) emit batchesRead(batches);
+}
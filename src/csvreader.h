@@ -0,0 +1,49 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include "batch.h"
+
+// parse a CSV file (RFC 4180) in a separate thread, the file is mapped in memory
+// and batches are sent by small groups while they are parsed
+class CsvReader : public QThread
+{
+	Q_OBJECT
+
+public:
+	CsvReader(const QString& filename, QObject* parent);
+	virtual ~CsvReader();
+
+	// parse next row, returns false at end of data
+	static bool readRow(const char*& p, const char* end, QByteArrayList& row);
+
+signals:
+	void batchesRead(const Batches& batches);
+	void error(const QString& error);
+
+protected:
+	void run();
+
+private:
+	QString m_filename;
+};
+
+#endif
@@ -24,17 +24,17 @@
 #define new DEBUG_NEW
 #endif
 
-DownloadEntry::DownloadEntry():reply(NULL), method(Method::Get), offset(0), count(0), type(0), fileoffset(0), filesize(0), supportsAcceptRanges(false), supportsContentRange(false), file(nullptr)
+DownloadEntry::DownloadEntry():id(0), batch(0), reply(NULL), method(Method::Get), offset(0), count(0), type(0), firstByteReceived(false), fileoffset(0), filesize(0), supportsAcceptRanges(false), supportsContentRange(false), file(nullptr)
 {
 }
 
-DownloadEntry::DownloadEntry(const DownloadEntry& entry) : reply(nullptr), url(entry.url), filename(entry.filename),
+DownloadEntry::DownloadEntry(const DownloadEntry& entry) : id(entry.id), batch(entry.batch), reply(nullptr), url(entry.url), filename(entry.filename),
 referer(entry.referer), method(entry.method), headers(entry.headers), parameters(entry.parameters),
 offset(entry.offset), offsetParameter(entry.offsetParameter), count(entry.count), countParameter(entry.countParameter),
-type(entry.type), error(entry.error), data(entry.data), time(entry.time), downloadStart(entry.downloadStart),
+type(entry.type), error(entry.error), data(entry.data), time(entry.time), downloadStart(entry.downloadStart), firstByteReceived(false),
 fileoffset(entry.fileoffset), filesize(entry.filesize),
 supportsAcceptRanges(entry.supportsAcceptRanges), supportsContentRange(entry.supportsContentRange),
-fullPath(entry.fullPath), file(entry.file)
+fullPath(entry.fullPath), file(entry.file), checksum(entry.checksum), mirrors(entry.mirrors), originalUrl(entry.originalUrl)
 {
 }
 
@@ -55,6 +55,8 @@ bool DownloadEntry::operator == (const DownloadEntry& entry) const
 
 DownloadEntry& DownloadEntry::operator = (const DownloadEntry& entry)
 {
+	id = entry.id;
+	batch = entry.batch;
 	reply = nullptr;
 	url = entry.url;
 	filename = entry.filename;
@@ -68,8 +70,11 @@ DownloadEntry& DownloadEntry::operator = (const DownloadEntry& entry)
 	countParameter = entry.countParameter;
 	type = entry.type;
 	error = entry.error;
+	data = entry.data;
 	time = entry.time;
 	downloadStart = entry.downloadStart;
+	requestTimer.invalidate();
+	firstByteReceived = false;
 
 	fileoffset = entry.fileoffset;
 	filesize = entry.filesize;
@@ -81,11 +86,19 @@ DownloadEntry& DownloadEntry::operator = (const DownloadEntry& entry)
 
 	file = nullptr;
 
+	checksum = entry.checksum;
+	mirrors = entry.mirrors;
+	originalUrl = entry.originalUrl;
+
+	resetHashes();
+
 	return *this;
 }
 
 void DownloadEntry::reset()
 {
+	id = 0;
+	batch = 0;
 	reply = nullptr;
 	url.clear();
 	filename.clear();
@@ -99,8 +112,11 @@ void DownloadEntry::reset()
 	countParameter.clear();
 	type = 0;
 	error.clear();
+	data.clear();
 	time = QDateTime();
 	downloadStart = QDateTime();
+	requestTimer.invalidate();
+	firstByteReceived = false;
 
 	fileoffset = 0;
 	filesize = 0;
@@ -111,6 +127,12 @@ void DownloadEntry::reset()
 	fullPath.clear();
 
 	file = nullptr;
+
+	checksum.clear();
+	mirrors.clear();
+	originalUrl.clear();
+
+	resetHashes();
 }
 
 bool DownloadEntry::checkDownloadedFile() const
@@ -130,11 +152,33 @@ bool DownloadEntry::openFile()
 
 	file.reset(new QFile(fullPath));
 
-	if (file->open(QFile::Append)) return true;
+	// data are written by large chunks, don't copy them in QFile buffer
+	if (!file->open(QFile::Append | QFile::Unbuffered))
+	{
+		closeFile();
 
-	closeFile();
+		return false;
+	}
 
-	return false;
+	// resuming, hashes must include data already on disk
+	if ((sha256 || md5) && file->size() > 0)
+	{
+		QFile existing(fullPath);
+
+		if (!existing.open(QFile::ReadOnly))
+		{
+			closeFile();
+
+			return false;
+		}
+
+		while (!existing.atEnd())
+		{
+			updateHashes(existing.read(1024 * 1024));
+		}
+	}
+
+	return true;
 }
 
 void DownloadEntry::closeFile()
@@ -147,7 +191,36 @@ void DownloadEntry::closeFile()
 	file.clear();
 }
 
+void DownloadEntry::initHashes(bool useSha256, bool useMd5)
+{
+	resetHashes();
+
+	if (useSha256) sha256.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+	if (useMd5) md5.reset(new QCryptographicHash(QCryptographicHash::Md5));
+}
+
+void DownloadEntry::updateHashes(const QByteArray& data)
+{
+	if (sha256) sha256->addData(data);
+	if (md5) md5->addData(data);
+}
+
+void DownloadEntry::resetHashes()
+{
+	sha256.clear();
+	md5.clear();
+}
+
 bool DownloadEntry::supportsResume() const
 {
 	return supportsAcceptRanges && supportsContentRange;
 }
+
+DownloadEvent::DownloadEvent():id(0), batch(0), type(0), offset(0), count(0), filesize(0)
+{
+}
+
+DownloadEvent::DownloadEvent(const DownloadEntry& entry):id(entry.id), batch(entry.batch), type(entry.type), offset(entry.offset), count(entry.count), filesize(entry.filesize),
+url(entry.url), filename(entry.filename), fullPath(entry.fullPath)
+{
+}
@@ -44,6 +44,12 @@ struct DownloadEntry
 	bool openFile();
 	void closeFile();
 
+	void initHashes(bool useSha256, bool useMd5);
+	void updateHashes(const QByteArray& data);
+	void resetHashes();
+
+	int id; // unique in queue
+	int batch; // ID of batch in queue, 0 by default
 	QNetworkReply* reply;
 	QString url;
 	QString filename;
@@ -60,6 +66,8 @@ struct DownloadEntry
 	QString data;
 	QDateTime time;
 	QDateTime downloadStart;
+	QElapsedTimer requestTimer; // started when request is sent, only for metrics
+	bool firstByteReceived;
 
 	qint64 fileoffset;
 	qint64 filesize;
@@ -69,6 +77,32 @@ struct DownloadEntry
 
 	QString fullPath;
 	QSharedPointer<QFile> file; // for head
+
+	QString checksum; // MD5 embedded in URL
+	QStringList mirrors; // other URLs of the same file, tried when url fails
+	QString originalUrl; // before a cached redirection was applied, empty if none
+	QSharedPointer<QCryptographicHash> sha256; // computed while downloading
+	QSharedPointer<QCryptographicHash> md5; // only computed if checksum is known
 };
 
+// sent with signals instead of the whole entry, copying it only costs a few reference counts
+// whatever the number of headers or parameters, full entry can be retrieved by its ID
+struct DownloadEvent
+{
+	DownloadEvent();
+	DownloadEvent(const DownloadEntry& entry);
+
+	int id;
+	int batch;
+	int type;
+	int offset;
+	int count;
+	qint64 filesize;
+	QString url;
+	QString filename;
+	QString fullPath;
+};
+
+Q_DECLARE_METATYPE(DownloadEvent)
+
 #endif
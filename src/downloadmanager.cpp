@@ -23,14 +23,39 @@
 
 #include "functions.h"
 #include "downloadentry.h"
+#include "contentstore.h"
+#include "filewriter.h"
+#include "downloadqueue.h"
+#include "requesttemplate.h"
 #include "qzipreader.h"
+#include "utils.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "harrecorder.h"
+#include "mirrorstats.h"
+#include "redirectcache.h"
+#include "hostprefetcher.h"
 
 #ifdef DEBUG_NEW
 #define new DEBUG_NEW
 #endif
 
-DownloadManager::DownloadManager(QObject *parent) : QObject(parent), m_mustStop(false), m_stopOnError(true), m_stopOnExpired(false), m_queueInitialSize(0)
+// maximum number of deleted entries kept for reuse
+#define MAX_FREE_ENTRIES 256
+
+// number of next entries whose hosts are resolved in advance
+#define MAX_PREFETCHED_HOSTS 16
+
+// prefetched pages are aborted when nothing is received during this time
+#define PREFETCH_TIMEOUT 60000
+
+// data of a file kept in memory by a reply while disk is busy, server is slowed down then
+#define REPLY_BUFFER_SIZE (4 * 1024 * 1024)
+
+DownloadManager::DownloadManager(QObject *parent) : QObject(parent), m_mustStop(false), m_running(false), m_stopOnError(true), m_stopOnExpired(false), m_checksumManifest(false), m_verifyChecksums(false), m_contentStore(nullptr), m_durability(Durability::None), m_requestTemplate(nullptr), m_prefetchPages(0), m_queueInitialSize(0), m_queueCpuTime(0), m_lastEntryId(0), m_har(nullptr), m_prefetchHosts(true)
 {
+	qRegisterMetaType<DownloadEvent>("DownloadEvent");
+
 	m_manager = new QNetworkAccessManager(this);
 
 	connect(m_manager, &QNetworkAccessManager::proxyAuthenticationRequired, this, &DownloadManager::onAuthentication);
@@ -44,21 +69,48 @@ DownloadManager::DownloadManager(QObject *parent) : QObject(parent), m_mustStop(
 	m_timerDownload->setSingleShot(true);
 	m_timerDownload->setInterval(300000);
 	connect(m_timerDownload, &QTimer::timeout, this, &DownloadManager::onTimeout);
+
+	m_writer = new FileWriter(this);
+
+	connect(m_writer, &FileWriter::available, this, &DownloadManager::onWriterAvailable);
+
+	memset(&m_statistics, 0, sizeof(m_statistics));
+
+	m_queue = new DownloadQueue();
+
+	m_mirrorStats = new MirrorStats();
+	m_redirects = new RedirectCache();
+
+	m_hostPrefetcher = new HostPrefetcher(m_manager, this);
 }
 
 DownloadManager::~DownloadManager()
 {
 	reset();
+
+	delete m_queue;
+
+	qDeleteAll(m_freeEntries);
+	m_freeEntries.clear();
+
+	delete m_contentStore;
+	delete m_requestTemplate;
+
+	// complete JSON before writer is deleted
+	delete m_har;
+
+	delete m_mirrorStats;
+	delete m_redirects;
 }
 
 int DownloadManager::count() const
 {
-	return (int)m_entries.size();
+	return (int)m_entries.size() + m_queue->size();
 }
 
 bool DownloadManager::isEmpty() const
 {
-	return m_entries.empty();
+	return m_entries.empty() && m_queue->isEmpty();
 }
 
 bool DownloadManager::saveFile(DownloadEntry* entry, const QByteArray &data)
@@ -91,6 +143,16 @@ bool DownloadManager::saveFile(DownloadEntry* entry, const QByteArray &data)
 
 			return false;
 		}
+
+		Tracer::instant(entry->id, "file saved");
+
+		syncEntryFile(*entry);
+
+		initEntryHashes(entry);
+
+		entry->updateHashes(data);
+
+		if (!processChecksums(entry)) return false;
 	}
 
 	emit downloadSaved(*entry);
@@ -100,14 +162,78 @@ bool DownloadManager::saveFile(DownloadEntry* entry, const QByteArray &data)
 
 DownloadEntry* DownloadManager::findEntry(const DownloadEntry &entry) const
 {
-	foreach(DownloadEntry *e, m_entries)
+	// only compare entries with the same URL
+	QMultiHash<QString, DownloadEntry*>::const_iterator it = m_entriesByUrl.constFind(entry.url);
+
+	while (it != m_entriesByUrl.constEnd() && it.key() == entry.url)
 	{
-		if (*e == entry) return e;
+		if (*it.value() == entry) return it.value();
+
+		++it;
 	}
 
 	return NULL;
 }
 
+const DownloadEntry* DownloadManager::entry(int id) const
+{
+	return m_entriesById.value(id);
+}
+
+void DownloadManager::appendEntry(DownloadEntry* entry)
+{
+	entry->id = ++m_lastEntryId;
+
+	m_entries << entry;
+
+	m_entriesById[entry->id] = entry;
+	m_entriesByUrl.insert(entry->url, entry);
+
+	if (Tracer::isEnabled())
+	{
+		Tracer::setName(entry->id, entry->url);
+		Tracer::instant(entry->id, "taken from queue");
+	}
+}
+
+void DownloadManager::deleteEntry(DownloadEntry* entry)
+{
+	m_entriesById.remove(entry->id);
+	m_entriesByUrl.remove(entry->url, entry);
+
+	closeEntryFile(entry);
+
+	releaseEntry(entry);
+}
+
+DownloadEntry* DownloadManager::acquireEntry()
+{
+	if (m_freeEntries.isEmpty()) return new DownloadEntry();
+
+	return m_freeEntries.takeLast();
+}
+
+void DownloadManager::releaseEntry(DownloadEntry* entry)
+{
+	if (m_freeEntries.size() >= MAX_FREE_ENTRIES)
+	{
+		delete entry;
+		return;
+	}
+
+	if (entry->reply)
+	{
+		entry->reply->deleteLater();
+	}
+
+	entry->closeFile();
+
+	// keep it to be reused by next entries
+	entry->reset();
+
+	m_freeEntries << entry;
+}
+
 DownloadEntry* DownloadManager::findEntryByNetworkReply(QNetworkReply *reply) const
 {
 	foreach(DownloadEntry *entry, m_entries)
@@ -120,45 +246,203 @@ DownloadEntry* DownloadManager::findEntryByNetworkReply(QNetworkReply *reply) co
 
 void DownloadManager::addToQueue(const DownloadEntry &lentry)
 {
-	if (findEntry(lentry)) return;
+	if (findEntry(lentry) || m_queue->contains(lentry)) return;
 
-	m_entries << new DownloadEntry(lentry);
+	// full entry will be created just before downloading it
+	m_queue->append(lentry);
+
+	// added while other entries are downloaded
+	if (m_running) ++m_queueInitialSize;
 
 	emit downloadQueued(lentry.url);
 }
 
 void DownloadManager::removeFromQueue(const QString &url)
 {
-	DownloadEntry *entry = NULL;
-	int index = -1;
+	DownloadEntry *entry = nullptr;
 
-	for (int i = 0, len = m_entries.size(); i < len; ++i)
+	// several entries can have the same URL, hash returns the last inserted one
+	if (m_entriesByUrl.contains(url))
 	{
-		entry = m_entries[i];
-
-		if (entry && entry->url == url)
+		foreach(DownloadEntry *e, m_entries)
 		{
-			index = i;
-			break;
+			if (e->url == url)
+			{
+				entry = e;
+				break;
+			}
 		}
 	}
 
-	if (index != -1)
+	if (entry)
+	{
+		removeFromQueue(entry);
+	}
+	else
+	{
+		int batch = m_queue->remove(url);
+
+		if (batch > -1) processBatchProgress(batch);
+	}
+}
+
+void DownloadManager::removeFromQueue(DownloadEntry *entry)
+{
+	int batch = entry->batch;
+
+	m_entries.removeAll(entry);
+
+	deleteEntry(entry);
+
+	m_queue->finish(batch);
+
+	++m_statistics.files;
+
+	Metrics::increment("downloads_total");
+
+	updateMetrics();
+
+	processBatchProgress(batch);
+}
+
+void DownloadManager::updateMetrics()
+{
+	Metrics::setGauge("queue_size", m_queue->size());
+	Metrics::setGauge("requests_in_flight", m_entries.size());
+}
+
+void DownloadManager::processResponseFinished(DownloadEntry* entry, QNetworkReply* reply, int statusCode)
+{
+	// only a pointer check when disabled
+	if (m_har)
 	{
-		m_entries.removeAt(index);
+		QNetworkCookieJar* cookieJar = m_manager->cookieJar();
 
-		if (entry)
+		qint64 duration = 0;
+
+		if (entry->requestTimer.isValid())
+		{
+			duration = entry->requestTimer.elapsed();
+		}
+		else if (reply->property("requestStart").isValid())
+		{
+			// prefetched page, it could have finished before being adopted
+			QVariant end = reply->property("requestEnd");
+
+			duration = (end.isValid() ? end.toLongLong() : QDateTime::currentMSecsSinceEpoch()) - reply->property("requestStart").toLongLong();
+		}
+
+		m_har->record(reply, cookieJar ? cookieJar->cookiesForUrl(reply->url()) : QList<QNetworkCookie>(), qMax(duration, (qint64)0));
+	}
+
+	// 0 when no response was received, don't format it when disabled
+	if (Metrics::isEnabled()) Metrics::increment(QString("responses_total{code=\"%1\"}").arg(statusCode));
+
+	// prefetched pages are not measured
+	if (entry->requestTimer.isValid())
+	{
+		if (reply->error() == QNetworkReply::NoError)
 		{
-			delete entry;
+			// HEAD only measures latency, GET also measures speed
+			if (reply->operation() == QNetworkAccessManager::HeadOperation)
+			{
+				m_mirrorStats->addLatency(entry->url, entry->requestTimer.elapsed());
+			}
+			else if (statusCode == 200 || statusCode == 206)
+			{
+				m_mirrorStats->addThroughput(entry->url, reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(), entry->requestTimer.elapsed());
+			}
 		}
+
+		Metrics::observe("request_duration_seconds", (double)entry->requestTimer.nsecsElapsed() / 1000000000.0);
+
+		entry->requestTimer.invalidate();
+
+		// last byte received
+		Tracer::end(entry->id);
 	}
 }
 
-void DownloadManager::removeFromQueue(DownloadEntry *entry)
+void DownloadManager::updateStatistics()
 {
-	m_entries.removeAll(entry);
+	if (!m_queueTimer.isValid()) return;
+
+	m_statistics.elapsed = m_queueTimer.elapsed();
+	m_statistics.cpuTime = getProcessCpuTime() - m_queueCpuTime;
+	m_statistics.peakMemory = getPeakMemoryUsage();
+}
+
+DownloadStatistics DownloadManager::statistics() const
+{
+	DownloadStatistics statistics = m_statistics;
+
+	// still running
+	if (m_running && m_queueTimer.isValid())
+	{
+		statistics.elapsed = m_queueTimer.elapsed();
+		statistics.cpuTime = getProcessCpuTime() - m_queueCpuTime;
+		statistics.peakMemory = getPeakMemoryUsage();
+	}
+
+	return statistics;
+}
+
+void DownloadManager::processBatchProgress(int batch)
+{
+	int done = 0, total = 0;
+
+	// batch removed
+	if (!m_queue->batchProgress(batch, done, total)) return;
+
+	emit batchProgress(batch, done, total);
+
+	if (m_queue->isBatchFinished(batch))
+	{
+		m_queue->removeBatch(batch);
+
+		emit batchFinished(batch);
+	}
+}
 
-	delete entry;
+void DownloadManager::finishEmptyBatches()
+{
+	// batches without any entry never receive progress, they can still be filled when notified
+	foreach(int batch, m_queue->finishedBatches())
+	{
+		processBatchProgress(batch);
+	}
+}
+
+int DownloadManager::createBatch(int priority, int weight)
+{
+	return m_queue->createBatch(priority, weight);
+}
+
+bool DownloadManager::setBatchPriority(int batch, int priority, int weight)
+{
+	return m_queue->setBatchPriority(batch, priority, weight);
+}
+
+void DownloadManager::pauseBatch(int batch)
+{
+	// entry being downloaded is not interrupted
+	m_queue->setBatchPaused(batch, true);
+}
+
+void DownloadManager::resumeBatch(int batch)
+{
+	m_queue->setBatchPaused(batch, false);
+
+	// all other batches were paused
+	if (m_running && m_entries.isEmpty()) downloadNextFile();
+}
+
+void DownloadManager::removeBatch(int batch)
+{
+	m_queue->removeBatch(batch);
+
+	// only paused entries were remaining
+	if (m_running && m_entries.isEmpty()) downloadNextFile();
 }
 
 void DownloadManager::onAuthentication(const QNetworkProxy &/* proxy */, QAuthenticator * /* auth */)
@@ -206,21 +490,48 @@ void DownloadManager::onMetaDataChanged()
 void DownloadManager::reset()
 {
 	m_mustStop = false;
+	m_running = false;
 
 	foreach(DownloadEntry *entry, m_entries)
 	{
 		if (entry)
 		{
-			delete entry;
+			deleteEntry(entry);
 		}
 	}
 
 	m_entries.clear();
+
+	m_queue->clear();
+
+	// pages requested in advance
+	foreach(QNetworkReply *reply, m_prefetches)
+	{
+		reply->abort();
+		reply->deleteLater();
+	}
+
+	m_prefetches.clear();
 }
 
 void DownloadManager::start()
 {
-	m_queueInitialSize = m_entries.size();;
+	// entries added later are processed with the others
+	if (m_running) return;
+
+	m_running = true;
+
+	// manifests could have been modified since last queue
+	m_manifestFiles.clear();
+
+	finishEmptyBatches();
+
+	m_queueInitialSize = count();
+
+	memset(&m_statistics, 0, sizeof(m_statistics));
+
+	m_queueTimer.start();
+	m_queueCpuTime = getProcessCpuTime();
 
 	emit queueStarted(m_queueInitialSize);
 
@@ -230,6 +541,9 @@ void DownloadManager::start()
 void DownloadManager::stop()
 {
 	m_mustStop = true;
+
+	// waiting for paused batches, nothing will call it
+	if (m_running && m_entries.isEmpty()) downloadNextFile();
 }
 
 void DownloadManager::downloadNextFile()
@@ -237,6 +551,13 @@ void DownloadManager::downloadNextFile()
 	// download aborted, queue finished and reset all items
 	if (m_mustStop)
 	{
+		m_running = false;
+
+		updateStatistics();
+
+		m_mirrorStats->save();
+		m_redirects->save();
+
 		emit queueFinished(true);
 
 		reset();
@@ -244,15 +565,46 @@ void DownloadManager::downloadNextFile()
 		return;
 	}
 
+	if (isEmpty()) finishEmptyBatches();
+
 	// queue finished
 	if (isEmpty())
 	{
+		m_running = false;
+
+		updateStatistics();
+
+		m_mirrorStats->save();
+		m_redirects->save();
+
 		emit queueProgress(m_queueInitialSize, m_queueInitialSize);
 		emit queueFinished(false);
 
 		return;
 	}
 
+	// create the full entry of next queued item
+	if (m_entries.isEmpty())
+	{
+		DownloadEntry* next = acquireEntry();
+
+		// only paused batches remaining
+		if (!m_queue->takeFirst(*next))
+		{
+			releaseEntry(next);
+			return;
+		}
+
+		if (next->checksum.isEmpty()) next->checksum = getChecksumFromUrl(next->url);
+
+		selectMirror(next);
+		applyCachedRedirection(next);
+
+		appendEntry(next);
+
+		updateMetrics();
+	}
+
 	// process next item
 	DownloadEntry *entry = m_entries.front();
 
@@ -260,6 +612,8 @@ void DownloadManager::downloadNextFile()
 
 	if (downloadEntry(entry))
 	{
+		prefetchHosts(*entry);
+
 		emit queueProgress(m_queueInitialSize - count(), m_queueInitialSize);
 	}
 }
@@ -267,13 +621,21 @@ void DownloadManager::downloadNextFile()
 bool DownloadManager::download(const DownloadEntry &entry)
 {
 	// already in queue
-	if (findEntry(entry)) return false;
+	if (findEntry(entry) || m_queue->contains(entry)) return false;
 
 	// make a copy of entry
-	DownloadEntry *e = new DownloadEntry(entry);
+	DownloadEntry *e = acquireEntry();
+	*e = entry;
+
+	if (e->checksum.isEmpty()) e->checksum = getChecksumFromUrl(e->url);
+
+	selectMirror(e);
+	applyCachedRedirection(e);
 
 	// add entry in queue
-	m_entries << e;
+	appendEntry(e);
+
+	m_queue->addActive(e->batch);
 
 	emit downloadQueued(entry.url);
 
@@ -287,15 +649,7 @@ bool DownloadManager::checkEntryFileOffset(DownloadEntry* entry)
 	{
 		emit downloadInfo(tr("File already open, flushing and closing it"), *entry);
 
-		entry->file->flush();
-		entry->file->close();
-
-		entry->file->deleteLater();
-
-		entry->file = nullptr;
-
-		// sleep 1 second to wait for flush
-		QThread::sleep(1);
+		closeEntryFile(entry);
 	}
 
 	entry->fileoffset = 0;
@@ -338,6 +692,37 @@ bool DownloadManager::checkEntryFileOffset(DownloadEntry* entry)
 	return true;
 }
 
+bool DownloadManager::closeEntryFile(DownloadEntry* entry)
+{
+	if (!entry->file) return true;
+
+	// time spent waiting for disk
+	Tracer::begin(entry->id, "close file");
+
+	// close it after all pending writes
+	m_writer->close(entry->file);
+	m_writer->waitForFile(entry->file);
+
+	bool res = !m_writer->takeError(entry->file);
+
+	entry->closeFile();
+
+	Tracer::end(entry->id);
+
+	return res;
+}
+
+void DownloadManager::syncEntryFile(const DownloadEntry& entry)
+{
+	// partial files will be downloaded again, they are not synced
+	if (m_durability == Durability::None) return;
+
+	// don't wait for them, files and directories are synced in groups
+	m_writer->syncFile(entry.fullPath);
+
+	if (m_durability == Durability::Directory) m_writer->syncDirectory(QFileInfo(entry.fullPath).absolutePath());
+}
+
 bool DownloadManager::downloadEntry(DownloadEntry *entry)
 {
 	if (entry->reply)
@@ -363,116 +748,50 @@ bool DownloadManager::downloadEntry(DownloadEntry *entry)
 		return false;
 	}
 
-	QNetworkRequest request;
-
-	// set referer header
-	if (!entry->referer.isEmpty()) request.setRawHeader("Referer", entry->referer.toLatin1());
+	// same content already downloaded elsewhere
+	if (linkDuplicate(entry))
+	{
+		removeFromQueue(entry);
 
-	// user agent is always global
-	if (!m_userAgent.isEmpty()) request.setRawHeader("User-Agent", m_userAgent.toLatin1());
+		// don't recurse, a lot of files could be linked in a row
+		QTimer::singleShot(0, this, &DownloadManager::downloadNextFile);
 
-	if (entry->headers.contains("Accept"))
-	{
-		// custom Accept value
-		request.setRawHeader("Accept", entry->headers["Accept"].toLatin1());
-	}
-	else
-	{
-		// default Accept value
-		request.setRawHeader("Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+		return true;
 	}
 
-	request.setRawHeader("Accept-Language", "fr-FR,fr;q=0.9,en-US;q=0.8,en;q=0.7");
+	// build it only once for all entries of a same batch
+	if (!m_requestTemplate || !m_requestTemplate->matches(*entry))
+	{
+		delete m_requestTemplate;
 
-	// append custom headers
-	QMap<QString, QString>::ConstIterator it = entry->headers.constBegin(), iend = entry->headers.constEnd();
+		m_requestTemplate = new RequestTemplate(*entry, m_userAgent);
+	}
 
-	while (it != iend)
+	// page already requested while previous ones were processed
+	if (adoptPrefetch(entry))
 	{
-		// Accept already processed before
-		if (it.key() != "Accept") request.setRawHeader(it.key().toUtf8(), it.value().toUtf8());
+		Tracer::instant(entry->id, "prefetched");
 
-		++it;
+		return true;
 	}
 
+	QNetworkRequest request = m_requestTemplate->request(*entry);
+
 	QNetworkReply *reply = NULL;
 
 	if (entry->method == DownloadEntry::Method::Post)
 	{
 		request.setUrl(url);
 
-		if (entry->headers.contains("Content-Type") && !entry->data.isEmpty())
-		{
-			// build parameters
-			reply = m_manager->post(request, entry->data.toUtf8());
-		}
-		else
-		{
-			// required
-			request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded; charset=UTF-8");
-
-			QUrlQuery params;
-
-			// reset iterators
-			it = entry->parameters.constBegin();
-			iend = entry->parameters.constEnd();
+		Tracer::begin(entry->id, "POST");
 
-			while (it != iend)
-			{
-				params.addQueryItem(it.key(), it.value());
-
-				++it;
-			}
-
-			// append offset
-			if (!entry->offsetParameter.isEmpty()) params.addQueryItem(entry->offsetParameter, QString::number(entry->offset));
-
-			// append count
-			if (!entry->countParameter.isEmpty()) params.addQueryItem(entry->countParameter, QString::number(entry->count));
-
-			// build parameters
-			reply = m_manager->post(request, params.query().toUtf8());
-		}
+		reply = m_manager->post(request, m_requestTemplate->postData(*entry));
 
 		connect(reply, &QNetworkReply::finished, this, &DownloadManager::onPostFinished);
 	}
 	else if (entry->method == DownloadEntry::Method::Get || entry->method == DownloadEntry::Method::Head)
 	{
-		QString query = url.query();
-
-		// reset iterators
-		it = entry->parameters.constBegin();
-		iend = entry->parameters.constEnd();
-
-		while (it != iend)
-		{
-			// and ampersand if existing parameters
-			if (!query.isEmpty()) query += "&";
-
-			query += it.key() + "=" + it.value();
-
-			++it;
-		}
-
-		// append offset
-		if (!entry->offsetParameter.isEmpty())
-		{
-			// and ampersand if existing parameters
-			if (!query.isEmpty()) query += "&";
-
-			query += entry->offsetParameter + "=" + QString::number(entry->offset);
-		}
-
-		// append count
-		if (!entry->countParameter.isEmpty())
-		{
-			// and ampersand if existing parameters
-			if (!query.isEmpty()) query += "&";
-
-			query += entry->countParameter + "=" + QString::number(entry->count);
-		}
-
-		url.setQuery(query);
+		url.setQuery(m_requestTemplate->query(url.query(), *entry));
 
 		request.setUrl(url);
 
@@ -490,6 +809,8 @@ bool DownloadManager::downloadEntry(DownloadEntry *entry)
 				return true;
 			}
 
+			Tracer::begin(entry->id, "HEAD");
+
 			reply = m_manager->head(request);
 
 			connect(reply, &QNetworkReply::finished, this, &DownloadManager::onHeadFinished);
@@ -518,6 +839,17 @@ bool DownloadManager::downloadEntry(DownloadEntry *entry)
 					return true;
 				}
 
+				// server can't resume, don't append full content to partial file
+				if (entry->fileoffset > 0 && !entry->supportsResume())
+				{
+					QFile::remove(entry->fullPath);
+
+					entry->fileoffset = 0;
+				}
+
+				// hashes are updated while receiving data
+				initEntryHashes(entry);
+
 				if (!entry->openFile())
 				{
 					emit downloadError(tr("Unable to write file"), *entry);
@@ -536,8 +868,13 @@ bool DownloadManager::downloadEntry(DownloadEntry *entry)
 
 			emit downloadStarted(*entry);
 
+			Tracer::begin(entry->id, "GET");
+
 			reply = m_manager->get(request);
 
+			// don't keep whole file in memory when disk is slower
+			if (entry->file) reply->setReadBufferSize(REPLY_BUFFER_SIZE);
+
 			connect(reply, &QNetworkReply::finished, this, &DownloadManager::onGetFinished);
 			connect(reply, &QNetworkReply::readyRead, this, &DownloadManager::onReadyRead);
 			connect(reply, &QNetworkReply::downloadProgress, this, &DownloadManager::onProgress);
@@ -556,18 +893,276 @@ bool DownloadManager::downloadEntry(DownloadEntry *entry)
 	}
 
 	entry->reply = reply;
+	entry->requestTimer.start();
+	entry->firstByteReceived = false;
+
+	Metrics::increment("requests_total");
+
+	m_hostPrefetcher->processRequest(url);
+
+	if (Tracer::isEnabled())
+	{
+		int id = entry->id;
+
+		// Qt doesn't report DNS resolution separately, it's included in connection
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+		connect(reply, &QNetworkReply::socketStartedConnecting, this, [id]() { Tracer::instant(id, "connecting"); });
+		connect(reply, &QNetworkReply::requestSent, this, [id]() { Tracer::instant(id, "request sent"); });
+#endif
+		connect(reply, &QNetworkReply::encrypted, this, [id]() { Tracer::instant(id, "TLS established"); });
+		connect(reply, &QNetworkReply::metaDataChanged, this, [id]() { Tracer::instant(id, "headers received"); });
+	}
 
 	connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::errorOccurred), this, &DownloadManager::onReplyError);
 
 	m_timerConnection->start();
 
+	prefetchPages(*entry);
+
 	return true;
 }
 
-void DownloadManager::setUserAgent(const QString &userAgent)
+bool DownloadManager::isPage(const DownloadEntry& entry) const
 {
-	m_userAgent = userAgent;
-}
+	// only pages returned in memory and with offset sent to server
+	if (entry.count < 1 || entry.offsetParameter.isEmpty() || !entry.fullPath.isEmpty()) return false;
+
+	if (entry.method == DownloadEntry::Method::Post) return !entry.headers.contains("Content-Type") || entry.data.isEmpty();
+
+	return entry.method == DownloadEntry::Method::Get;
+}
+
+QString DownloadManager::pageKey(const DownloadEntry& entry, int offset) const
+{
+	// same fields as DownloadEntry::operator ==, data and parameters can differ between batches
+	QString key = QString::number((int)entry.method) + "|" + QString::number(offset) + "|" + QString::number(entry.count) + "|" + entry.url + "|" + entry.data;
+
+	for (QMap<QString, QString>::const_iterator it = entry.parameters.constBegin(); it != entry.parameters.constEnd(); ++it)
+	{
+		key += "|" + it.key() + "=" + it.value();
+	}
+
+	return key;
+}
+
+void DownloadManager::prefetchPages(const DownloadEntry& entry)
+{
+	if (m_prefetchPages < 1 || !isPage(entry)) return;
+
+	int last = qMin(entry.offset + m_prefetchPages, entry.count);
+
+	for (int offset = entry.offset + 1; offset <= last; ++offset)
+	{
+		QString key = pageKey(entry, offset);
+
+		if (m_prefetches.contains(key)) continue;
+
+		DownloadEntry page(entry);
+		page.offset = offset;
+
+		// template was built for this batch
+		QNetworkRequest request = m_requestTemplate->request(page);
+		request.setTransferTimeout(PREFETCH_TIMEOUT);
+
+		QUrl url(page.url);
+
+		QNetworkReply *reply = NULL;
+
+		if (page.method == DownloadEntry::Method::Post)
+		{
+			request.setUrl(url);
+
+			reply = m_manager->post(request, m_requestTemplate->postData(page));
+		}
+		else
+		{
+			url.setQuery(m_requestTemplate->query(url.query(), page));
+
+			request.setUrl(url);
+
+			reply = m_manager->get(request);
+		}
+
+		if (!reply) continue;
+
+		// an entry adopting it has no request timer, HAR needs the real duration
+		reply->setProperty("requestStart", QDateTime::currentMSecsSinceEpoch());
+
+		connect(reply, &QNetworkReply::finished, reply, [reply]()
+		{
+			reply->setProperty("requestEnd", QDateTime::currentMSecsSinceEpoch());
+		});
+
+		// data are kept in reply until page is processed
+		m_prefetches[key] = reply;
+	}
+}
+
+bool DownloadManager::adoptPrefetch(DownloadEntry* entry)
+{
+	if (m_prefetches.isEmpty() || !isPage(*entry)) return false;
+
+	QNetworkReply *reply = m_prefetches.take(pageKey(*entry, entry->offset));
+
+	if (!reply) return false;
+
+	entry->reply = reply;
+
+	connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::errorOccurred), this, &DownloadManager::onReplyError);
+
+	bool post = entry->method == DownloadEntry::Method::Post;
+
+	if (!post)
+	{
+		// same as a normal GET
+		entry->downloadStart = QDateTime::currentDateTime();
+
+		emit downloadStarted(*entry);
+	}
+
+	if (reply->isFinished())
+	{
+		QPointer<QNetworkReply> finished(reply);
+
+		// process it later to not recurse through all prefetched pages
+		QTimer::singleShot(0, this, [this, finished, post]()
+		{
+			// queue reset in the meantime
+			if (!finished || !findEntryByNetworkReply(finished)) return;
+
+			if (post)
+			{
+				processPostReply(finished);
+			}
+			else
+			{
+				processGetReply(finished);
+			}
+		});
+	}
+	else
+	{
+		if (post)
+		{
+			connect(reply, &QNetworkReply::finished, this, &DownloadManager::onPostFinished);
+		}
+		else
+		{
+			connect(reply, &QNetworkReply::finished, this, &DownloadManager::onGetFinished);
+			connect(reply, &QNetworkReply::readyRead, this, &DownloadManager::onReadyRead);
+			connect(reply, &QNetworkReply::downloadProgress, this, &DownloadManager::onProgress);
+		}
+
+		m_timerConnection->start();
+	}
+
+	prefetchPages(*entry);
+
+	return true;
+}
+
+void DownloadManager::abortPrefetches(const DownloadEntry& entry)
+{
+	if (m_prefetches.isEmpty() || !isPage(entry)) return;
+
+	for (int offset = entry.offset + 1, last = entry.offset + m_prefetchPages; offset <= last; ++offset)
+	{
+		QNetworkReply *reply = m_prefetches.take(pageKey(entry, offset));
+
+		if (reply)
+		{
+			reply->abort();
+			reply->deleteLater();
+		}
+	}
+}
+
+void DownloadManager::prefetchHosts(const DownloadEntry& entry)
+{
+	// proxy resolves hosts itself
+	if (!m_prefetchHosts || m_proxy.type() == QNetworkProxy::HttpProxy) return;
+
+	QString host = QUrl(entry.url).host();
+	bool connected = false;
+
+	for (const QStringList& urls : m_queue->nextUrls(MAX_PREFETCHED_HOSTS))
+	{
+		// same host as the one which will be requested, like selectMirror and applyCachedRedirection
+		QString next = urls.size() > 1 ? m_mirrorStats->best(urls) : urls.first();
+		QString redirected = m_redirects->resolve(next);
+
+		QUrl url(redirected.isEmpty() ? next : redirected);
+
+		m_hostPrefetcher->resolve(url);
+
+		// connection to the same host will be reused
+		if (connected || url.host() == host) continue;
+
+		// warm up a connection for the next entry, its slot will be free soon
+		m_hostPrefetcher->preconnect(url);
+
+		connected = true;
+	}
+}
+
+void DownloadManager::setPrefetchHosts(bool enabled)
+{
+	m_prefetchHosts = enabled;
+
+	if (!enabled) m_hostPrefetcher->clear();
+}
+
+void DownloadManager::setPrefetchPages(int pages)
+{
+	m_prefetchPages = pages;
+}
+
+void DownloadManager::setMirrorStatsFile(const QString& filename)
+{
+	// keep values measured before
+	m_mirrorStats->save();
+	m_mirrorStats->load(filename);
+}
+
+void DownloadManager::setRedirectCacheFile(const QString& filename)
+{
+	m_redirects->save();
+	m_redirects->load(filename);
+}
+
+bool DownloadManager::setHarFile(const QString& filename)
+{
+	// keep appending to the same archive
+	if (filename == m_harFilename) return m_har != nullptr || filename.isEmpty();
+
+	delete m_har;
+	m_har = nullptr;
+
+	m_harFilename = filename;
+
+	if (filename.isEmpty()) return true;
+
+	m_har = new HarRecorder(m_writer);
+
+	if (!m_har->open(filename))
+	{
+		delete m_har;
+		m_har = nullptr;
+
+		return false;
+	}
+
+	return true;
+}
+
+void DownloadManager::setUserAgent(const QString &userAgent)
+{
+	m_userAgent = userAgent.toLatin1();
+
+	// headers changed
+	delete m_requestTemplate;
+	m_requestTemplate = nullptr;
+}
 
 void DownloadManager::setProxy(const QString &p)
 {
@@ -596,111 +1191,311 @@ void DownloadManager::setProxy(const QString &p)
 	m_manager->setProxy(m_proxy);
 }
 
-void DownloadManager::addCookie(const QNetworkCookie& cookie)
-{
-	m_manager->cookieJar()->insertCookie(cookie);
+void DownloadManager::addCookie(const QNetworkCookie& cookie)
+{
+	m_manager->cookieJar()->insertCookie(cookie);
+}
+
+void DownloadManager::setCookies(const QList<QNetworkCookie>& cookies, const QString &url)
+{
+	m_manager->cookieJar()->setCookiesFromUrl(cookies, url);
+}
+
+QList<QNetworkCookie> DownloadManager::getCookies(const QString& url)
+{
+	return m_manager->cookieJar()->cookiesForUrl(url);
+}
+
+bool DownloadManager::loadCookiesFromDirectory(const QString& directory, const QString& domain)
+{
+	QDir dir(directory);
+
+	if (!dir.exists()) return false;
+
+	QFileInfoList files = dir.entryInfoList(QStringList("*.txt"), QDir::Files | QDir::Readable | QDir::NoDotAndDotDot, QDir::Time);
+
+	if (files.isEmpty()) return false;
+
+	static const QRegularExpression reg("^[0-9a-f]{8}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{12}\\.txt$");
+
+	for (const QFileInfo& file : files)
+	{
+		// Example: 3b52e028-c80e-4b5d-a22d-62564d31d6c1.txt
+		if (!reg.match(file.fileName()).hasMatch()) continue;
+
+		if (loadCookiesFromFile(file.absoluteFilePath(), domain)) return true;
+	}
+
+	return false;
+}
+
+bool DownloadManager::loadCookiesFromFile(const QString& filename, const QString& domain2)
+{
+	QFile file(filename);
+
+	if (!file.open(QFile::ReadOnly)) return false;
+
+	QTextStream in(&file);
+
+	while (!in.atEnd())
+	{
+		// read each line and trim them
+		QString line = in.readLine().trimmed();
+
+		// skip it if empty
+		if (line.isEmpty()) continue;
+
+		// ignore comments
+		if (line[0] == '#') continue;
+
+		// split variables from <tab>
+		QStringList fields = line.split('\t');
+
+		// we expect 7 parameters
+		if (fields.size() != 7)
+		{
+			qDebug() << "not 7 parameters but" << fields.size();
+			continue;
+		}
+
+		QNetworkCookie cookie;
+
+		int i = 0;
+
+		QString domain = fields[i++];
+		bool access = fields[i++] == "TRUE";
+		QString path = fields[i++];
+		bool secure = fields[i++] == "TRUE";
+		qint64 expiration = fields[i++].toLongLong();
+		QString name = fields[i++];
+		QString value = fields[i++];
+
+		cookie.setDomain(domain);
+		cookie.setPath(path);
+		cookie.setSecure(secure);
+
+		if (expiration > 0) cookie.setExpirationDate(QDateTime::fromSecsSinceEpoch(expiration));
+
+		cookie.setName(name.toUtf8());
+		cookie.setValue(value.toUtf8());
+
+		// add cookie
+		if (domain.isEmpty() || cookie.domain().indexOf(domain) > -1) addCookie(cookie);
+	}
+
+	file.close();
+
+	return true;
+}
+
+void DownloadManager::setStopOnError(bool stop)
+{
+	m_stopOnError = stop;
+}
+
+void DownloadManager::setStopOnExpired(bool stop)
+{
+	m_stopOnExpired = stop;
+}
+
+void DownloadManager::setChecksumManifest(bool enabled)
+{
+	m_checksumManifest = enabled;
+}
+
+void DownloadManager::setVerifyChecksums(bool verify)
+{
+	m_verifyChecksums = verify;
+}
+
+void DownloadManager::setDeduplicate(bool enabled)
+{
+	if (!enabled)
+	{
+		delete m_contentStore;
+		m_contentStore = nullptr;
+
+		return;
+	}
+
+	if (m_contentStore) return;
+
+	m_contentStore = new ContentStore();
+
+	QString filename = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/contentstore.txt";
+
+	if (!m_contentStore->open(filename))
+	{
+		qWarning() << "Unable to open content store" << filename;
+
+		delete m_contentStore;
+		m_contentStore = nullptr;
+	}
+}
+
+void DownloadManager::setDurability(Durability durability)
+{
+	m_durability = durability;
+}
+
+void DownloadManager::initEntryHashes(DownloadEntry* entry)
+{
+	entry->initHashes(m_checksumManifest || m_contentStore, m_verifyChecksums && !entry->checksum.isEmpty());
+}
+
+bool DownloadManager::processChecksums(DownloadEntry* entry)
+{
+	// checksum of URL can only be trusted once compared with content
+	bool verified = false;
+
+	if (entry->md5)
+	{
+		QString md5 = QString::fromLatin1(entry->md5->result().toHex());
+
+		if (md5 != entry->checksum)
+		{
+			// a corrupted file would be considered complete by next runs
+			QFile::remove(entry->fullPath);
+
+			processError(entry, tr("File %1 has a wrong checksum (%2 computed / %3 expected)").arg(entry->fullPath).arg(md5).arg(entry->checksum));
+
+			return false;
+		}
+
+		emit downloadInfo(tr("Checksum of %1 verified").arg(entry->filename), *entry);
+
+		verified = true;
+	}
+
+	QByteArray sha256;
+
+	if (entry->sha256) sha256 = entry->sha256->result();
+
+	entry->resetHashes();
+
+	if (m_checksumManifest && !sha256.isEmpty() && !updateChecksumManifest(entry->fullPath, sha256))
+	{
+		emit downloadWarning(tr("Unable to update checksums of %1").arg(entry->fullPath), *entry);
+	}
+
+	return processDuplicate(entry, sha256, verified);
+}
+
+QSet<QString>& DownloadManager::manifestFiles(const QString& directory)
+{
+	QHash<QString, QSet<QString> >::iterator it = m_manifestFiles.find(directory);
+
+	// manifest is only parsed once per directory and queue
+	if (it == m_manifestFiles.end())
+	{
+		QSet<QString> files;
+
+		foreach(const QString& filename, readChecksumManifest(directory))
+		{
+			files.insert(filename);
+		}
+
+		it = m_manifestFiles.insert(directory, files);
+	}
+
+	return it.value();
 }
 
-void DownloadManager::setCookies(const QList<QNetworkCookie>& cookies, const QString &url)
+bool DownloadManager::updateChecksumManifest(const QString& fullPath, const QByteArray& sha256)
 {
-	m_manager->cookieJar()->setCookiesFromUrl(cookies, url);
-}
+	QFileInfo info(fullPath);
 
-QList<QNetworkCookie> DownloadManager::getCookies(const QString& url)
-{
-	return m_manager->cookieJar()->cookiesForUrl(url);
+	QSet<QString>& files = manifestFiles(info.absolutePath());
+
+	// file downloaded again, don't keep its previous checksum
+	if (files.contains(info.fileName())) return replaceChecksumInManifest(fullPath, sha256);
+
+	if (!appendChecksumToManifest(fullPath, sha256)) return false;
+
+	files.insert(info.fileName());
+
+	return true;
 }
 
-bool DownloadManager::loadCookiesFromDirectory(const QString& directory, const QString& domain)
+void DownloadManager::addCompleteFileToManifest(const DownloadEntry& entry)
 {
-	QDir dir(directory);
+	if (!m_checksumManifest) return;
 
-	if (!dir.exists()) return false;
-
-	QFileInfoList files = dir.entryInfoList(QStringList("*.txt"), QDir::Files | QDir::Readable | QDir::NoDotAndDotDot, QDir::Time);
+	QFileInfo info(entry.fullPath);
 
-	if (files.isEmpty()) return false;
+	// only hash files which are not listed yet
+	if (manifestFiles(info.absolutePath()).contains(info.fileName())) return;
 
-	QRegularExpression reg("^[0-9a-f]{8}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{12}\\.txt$");
+	QByteArray sha256 = computeFileSha256(entry.fullPath);
 
-	for (const QFileInfo& file : files)
+	if (sha256.isEmpty() || !updateChecksumManifest(entry.fullPath, sha256))
 	{
-		// Example: 3b52e028-c80e-4b5d-a22d-62564d31d6c1.txt
-		if (!reg.match(file.fileName()).hasMatch()) continue;
-
-		if (loadCookiesFromFile(file.absoluteFilePath(), domain)) return true;
+		emit downloadWarning(tr("Unable to update checksums of %1").arg(entry.fullPath), entry);
 	}
-
-	return false;
 }
 
-bool DownloadManager::loadCookiesFromFile(const QString& filename, const QString& domain2)
+bool DownloadManager::processDuplicate(DownloadEntry* entry, const QByteArray& sha256, bool checksumVerified)
 {
-	QFile file(filename);
-
-	if (!file.open(QFile::ReadOnly)) return false;
+	if (!m_contentStore || sha256.isEmpty()) return true;
 
-	QTextStream in(&file);
+	QString key = ContentStore::sha256Key(sha256);
+	QString original = m_contentStore->find(key);
 
-	while (!in.atEnd())
+	if (!original.isEmpty() && QFileInfo(original) != QFileInfo(entry->fullPath))
 	{
-		// read each line and trim them
-		QString line = in.readLine().trimmed();
-
-		// skip it if empty
-		if (line.isEmpty()) continue;
+		// replace the new file by a link to the identical one
+		QString tmpPath = entry->fullPath + ".link";
 
-		// ignore comments
-		if (line[0] == '#') continue;
+		if (linkFile(original, tmpPath))
+		{
+			QFile::remove(entry->fullPath);
 
-		// split variables from <tab>
-		QStringList fields = line.split('\t');
+			if (QFile::rename(tmpPath, entry->fullPath))
+			{
+				emit downloadInfo(tr("File %1 is identical to %2, linked").arg(entry->filename).arg(original), *entry);
+			}
+			else
+			{
+				processError(entry, tr("Unable to rename %1").arg(tmpPath));
 
-		// we expect 7 parameters
-		if (fields.size() != 7)
-		{
-			qDebug() << "not 7 parameters but" << fields.size();
-			continue;
+				return false;
+			}
 		}
+	}
+	else
+	{
+		m_contentStore->insert(key, entry->fullPath);
+	}
 
-		QNetworkCookie cookie;
+	// any 32 hexadecimal digits of URL are considered as a checksum, only use matching ones
+	if (checksumVerified) m_contentStore->insert(ContentStore::checksumKey(entry->checksum), entry->fullPath);
 
-		int i = 0;
+	return true;
+}
 
-		QString domain = fields[i++];
-		bool access = fields[i++] == "TRUE";
-		QString path = fields[i++];
-		bool secure = fields[i++] == "TRUE";
-		qint64 expiration = fields[i++].toLongLong();
-		QString name = fields[i++];
-		QString value = fields[i++];
+bool DownloadManager::linkDuplicate(DownloadEntry* entry)
+{
+	// only possible when checksum is known before downloading, and verified for stored files
+	if (!m_contentStore || !m_verifyChecksums || entry->checksum.isEmpty() || entry->fullPath.isEmpty()) return false;
 
-		cookie.setDomain(domain);
-		cookie.setPath(path);
-		cookie.setSecure(secure);
+	if (entry->method != DownloadEntry::Method::Head && entry->method != DownloadEntry::Method::Get) return false;
 
-		if (expiration > 0) cookie.setExpirationDate(QDateTime::fromSecsSinceEpoch(expiration));
+	QString original = m_contentStore->find(ContentStore::checksumKey(entry->checksum));
 
-		cookie.setName(name.toUtf8());
-		cookie.setValue(value.toUtf8());
+	if (original.isEmpty() || QFile::exists(entry->fullPath)) return false;
 
-		// add cookie
-		if (domain.isEmpty() || cookie.domain().indexOf(domain) > -1) addCookie(cookie);
-	}
+	QString directory = QFileInfo(entry->fullPath).absolutePath();
 
-	file.close();
+	// create directory if not exists
+	if (!QFile::exists(directory)) QDir().mkpath(directory);
 
-	return true;
-}
+	// a copy is still faster than downloading it again
+	if (!linkFile(original, entry->fullPath) && !QFile::copy(original, entry->fullPath)) return false;
 
-void DownloadManager::setStopOnError(bool stop)
-{
-	m_stopOnError = stop;
-}
+	emit downloadInfo(tr("File %1 is identical to %2, linked").arg(entry->filename).arg(original), *entry);
+	emit downloadSaved(*entry);
 
-void DownloadManager::setStopOnExpired(bool stop)
-{
-	m_stopOnExpired = stop;
+	return true;
 }
 
 void DownloadManager::canceled()
@@ -719,7 +1514,15 @@ void DownloadManager::onReadyRead()
 
 	if (entry->file)
 	{
-		entry->file->write(reply->readAll());
+		if (m_writer->isBusy())
+		{
+			// read again when disk is available, reply stops receiving when its buffer is full
+			if (!m_waitingReplies.contains(reply)) m_waitingReplies << reply;
+		}
+		else
+		{
+			writeReplyData(entry, reply);
+		}
 	}
 
 	// abort after writing data to disk
@@ -729,6 +1532,56 @@ void DownloadManager::onReadyRead()
 	}
 }
 
+void DownloadManager::writeReplyData(DownloadEntry* entry, QNetworkReply* reply)
+{
+	while (reply->bytesAvailable() > 0)
+	{
+		// read chunks in recycled buffers instead of allocating a new QByteArray with readAll()
+		QByteArray data = m_writer->takeBuffer(reply->bytesAvailable());
+
+		qint64 len = reply->read(data.data(), data.size());
+
+		if (len <= 0) break;
+
+		data.resize(len);
+
+		m_statistics.bytes += len;
+
+		Metrics::increment("received_bytes_total", len);
+
+		// hash data while they are still in memory
+		entry->updateHashes(data);
+
+		// written in another thread
+		m_writer->write(entry->file, data);
+	}
+}
+
+void DownloadManager::onWriterAvailable()
+{
+	QList<QPointer<QNetworkReply> > replies;
+	replies.swap(m_waitingReplies);
+
+	for (const QPointer<QNetworkReply>& reply : replies)
+	{
+		// deleted or finished meanwhile
+		if (!reply) continue;
+
+		DownloadEntry* entry = findEntryByNetworkReply(reply);
+
+		if (!entry || !entry->file) continue;
+
+		if (m_writer->isBusy())
+		{
+			m_waitingReplies << reply;
+		}
+		else
+		{
+			writeReplyData(entry, reply);
+		}
+	}
+}
+
 void DownloadManager::onProgress(qint64 done, qint64 total)
 {
 	if (m_timerConnection->isActive())
@@ -745,6 +1598,15 @@ void DownloadManager::onProgress(qint64 done, qint64 total)
 
 	if (entry)
 	{
+		if (!entry->firstByteReceived && done > 0)
+		{
+			if (entry->requestTimer.isValid()) Metrics::observe("time_to_first_byte_seconds", (double)entry->requestTimer.nsecsElapsed() / 1000000000.0);
+
+			Tracer::instant(entry->id, "first byte");
+
+			entry->firstByteReceived = true;
+		}
+
 		qint64 current = entry->fileoffset + done;
 		qint64 size = entry->fileoffset + total;
 
@@ -775,7 +1637,7 @@ void DownloadManager::onProgress(qint64 done, qint64 total)
 	}
 }
 
-void DownloadManager::processRedirection(DownloadEntry* entry, const QString& redirection)
+void DownloadManager::processRedirection(DownloadEntry* entry, const QString& redirection, int statusCode)
 {
 	QString newUrl;
 
@@ -793,19 +1655,19 @@ void DownloadManager::processRedirection(DownloadEntry* entry, const QString& re
 
 	if (!newUrl.isEmpty())
 	{
+		Metrics::increment("redirects_total");
+
+		Tracer::instant(entry->id, "redirected");
+
 		emit downloadRedirected(newUrl, *entry);
 
+		// next entries will go directly to new URL
+		m_redirects->add(entry->url, newUrl, statusCode);
+
 		// use same parameters
 		entry->referer = entry->url;
-		entry->url = newUrl;
-
-		// redirection on another server, recheck resume
-		entry->supportsAcceptRanges = false;
-		entry->supportsContentRange = false;
 
-		entry->fileoffset = 0;
-		entry->filesize = 0;
-		entry->time = QDateTime();
+		setEntryUrl(entry, newUrl);
 	}
 	else
 	{
@@ -815,9 +1677,107 @@ void DownloadManager::processRedirection(DownloadEntry* entry, const QString& re
 	downloadNextFile();
 }
 
+void DownloadManager::selectMirror(DownloadEntry* entry)
+{
+	if (entry->mirrors.isEmpty()) return;
+
+	// fastest mirror first
+	QStringList urls = m_mirrorStats->sort(QStringList(entry->url) + entry->mirrors);
+
+	entry->url = urls.takeFirst();
+	entry->mirrors = urls;
+}
+
+bool DownloadManager::switchMirror(DownloadEntry* entry, const QString& error)
+{
+	// user stopped download or no more mirrors
+	if (m_mustStop || entry->mirrors.isEmpty()) return false;
+
+	m_mirrorStats->addFailure(entry->url);
+
+	QString url = entry->mirrors.takeFirst();
+
+	emit downloadWarning(tr("%1, trying mirror %2").arg(error).arg(url), *entry);
+
+	Metrics::increment("mirror_switches_total");
+
+	Tracer::instant(entry->id, "mirror switched");
+
+	// cached redirection was for previous mirror
+	entry->originalUrl.clear();
+
+	setEntryUrl(entry, url);
+
+	downloadNextFile();
+
+	return true;
+}
+
+void DownloadManager::setEntryUrl(DownloadEntry* entry, const QString& url)
+{
+	m_entriesByUrl.remove(entry->url, entry);
+
+	entry->url = url;
+
+	m_entriesByUrl.insert(entry->url, entry);
+
+	// another server, recheck resume
+	entry->supportsAcceptRanges = false;
+	entry->supportsContentRange = false;
+
+	entry->fileoffset = 0;
+	entry->filesize = 0;
+	entry->time = QDateTime();
+
+	// file may be partially written, negotiate resume again instead of appending the full content
+	if (entry->method == DownloadEntry::Method::Get && !entry->fullPath.isEmpty()) entry->method = DownloadEntry::Method::Head;
+}
+
+void DownloadManager::applyCachedRedirection(DownloadEntry* entry)
+{
+	QString url = m_redirects->resolve(entry->url);
+
+	if (url.isEmpty()) return;
+
+	Metrics::increment("redirect_cache_hits_total");
+
+	// entry is not in m_entriesByUrl yet
+	entry->originalUrl = entry->url;
+	entry->url = url;
+}
+
+bool DownloadManager::revertCachedRedirection(DownloadEntry* entry, const QString& error)
+{
+	if (m_mustStop || entry->originalUrl.isEmpty()) return false;
+
+	emit downloadWarning(tr("%1, retrying without cached redirection").arg(error), *entry);
+
+	// don't use it anymore
+	m_redirects->invalidate(entry->originalUrl);
+
+	QString url = entry->originalUrl;
+
+	entry->originalUrl.clear();
+
+	setEntryUrl(entry, url);
+
+	downloadNextFile();
+
+	return true;
+}
+
 void DownloadManager::processError(DownloadEntry* entry, const QString& error)
 {
+	// next pages are requested again if entry is retried
+	abortPrefetches(*entry);
+
+	// try original URL and next mirror before giving up
+	if (revertCachedRedirection(entry, error) || switchMirror(entry, error)) return;
+
+	Metrics::increment("errors_total");
+
 	emit downloadError(error, *entry);
+	emit downloadFailed(*entry);
 
 	removeFromQueue(entry);
 
@@ -834,35 +1794,16 @@ void DownloadManager::processContentDisposition(DownloadEntry *entry, const QStr
 {
 	if (contentDisposition.isEmpty()) return;
 
-	QString asciiFilename;
-
-	// both ASCII and UTF-8 filenames
-	QRegularExpression reg("^attachment; filename=\"([a-zA-Z0-9._-]+)\"; filename\\*=utf-8''([a-zA-Z0-9._-]+)$");
+	QString asciiFilename, utf8Filename;
 
-	QRegularExpressionMatch match = reg.match(contentDisposition);
-
-	if (match.hasMatch())
+	// ASCII filename and optionally UTF-8 filename
+	if (!parseContentDisposition(contentDisposition, &asciiFilename, &utf8Filename))
 	{
-		asciiFilename = match.captured(1);
-
-		QString utf8Filename = match.captured(2);
-
-		if (asciiFilename != utf8Filename)
-		{
-			emit downloadWarning(tr("UTF-8 and ASCII filenames are different (ASCII = '%1', UTF-8 = '%2')").arg(asciiFilename).arg(utf8Filename), *entry);
-		}
+		asciiFilename.clear();
 	}
-	else
+	else if (!utf8Filename.isEmpty() && asciiFilename != utf8Filename)
 	{
-		// ASCII filename
-		reg.setPattern("^attachment; filename=\"([a-zA-Z0-9._-]+)\"$");
-
-		match = reg.match(contentDisposition);
-
-		if (match.hasMatch())
-		{
-			asciiFilename = match.captured(1);
-		}
+		emit downloadWarning(tr("UTF-8 and ASCII filenames are different (ASCII = '%1', UTF-8 = '%2')").arg(asciiFilename).arg(utf8Filename), *entry);
 	}
 
 	if (entry->filename != asciiFilename)
@@ -907,21 +1848,18 @@ void DownloadManager::processAcceptRanges(DownloadEntry* entry, const QString& a
 void DownloadManager::processContentRange(DownloadEntry *entry, const QString &contentRange, qint64 contentLength)
 {
 	// server supports resume, part 2
-	QRegularExpression reg("^bytes ([0-9]+)-([0-9]+)/([0-9]+)$");
-
 	entry->fileoffset = 0;
 
 	if (entry->supportsAcceptRanges)
 	{
-		QRegularExpressionMatch match = reg.match(contentRange);
+		qint64 first = 0, last = 0, filesize = 0;
 
-		if (match.hasMatch())
+		if (parseContentRange(contentRange, &first, &last, &filesize))
 		{
 			entry->supportsContentRange = true;
-			entry->fileoffset = match.captured(1).toLongLong();
+			entry->fileoffset = first;
 
 			// when resuming, Content-Length is the size of missing parts to download
-			qint64 filesize = match.captured(3).toLongLong();
 
 			if (entry->filesize && entry->filesize != filesize)
 			{
@@ -955,6 +1893,11 @@ void DownloadManager::onGetFinished()
 	QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
 	Q_ASSERT(reply != nullptr);
 
+	processGetReply(reply);
+}
+
+void DownloadManager::processGetReply(QNetworkReply* reply)
+{
 	if (m_timerDownload->isActive()) m_timerDownload->stop();
 
 	int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
@@ -972,13 +1915,23 @@ void DownloadManager::onGetFinished()
 	DownloadEntry* entry = findEntryByNetworkReply(reply);
 	Q_ASSERT(entry != nullptr);
 
+	processResponseFinished(entry, reply, statusCode);
+
 	QByteArray data;
 
-	// don't need to call readAll() if all chunks already written to a file
-	if (!entry->file)
+	if (entry->file)
+	{
+		// data left in reply while disk was busy, writer never blocks
+		writeReplyData(entry, reply);
+	}
+	else
 	{
 		data = reply->readAll();
 
+		m_statistics.bytes += data.size();
+
+		Metrics::increment("received_bytes_total", data.size());
+
 		// if data are still compressed (deflate ?), uncompress them
 		if (contentEncoding == "gzip" && !data.isEmpty() && data.at(0) == 0x1f)
 		{
@@ -992,11 +1945,19 @@ void DownloadManager::onGetFinished()
 
 	if (error != QNetworkReply::NoError)
 	{
+		// connection of next pages is probably lost too, they'll be requested again
+		abortPrefetches(*entry);
+
 		if (error == QNetworkReply::OperationCanceledError && !m_stopOnError)
 		{
+			// timeout or server closed connection, use original URL or next mirror if any
+			if (revertCachedRedirection(entry, errorString) || switchMirror(entry, errorString)) return;
+
 			emit downloadError(tr("Download canceled by server or user: %1").arg(errorString), *entry);
 
 			// retry with head to resume download
+			Metrics::increment("retries_total");
+
 			entry->method = DownloadEntry::Method::Head;
 
 			entry->supportsAcceptRanges = false;
@@ -1062,7 +2023,15 @@ void DownloadManager::onGetFinished()
 		{
 			if (entry->file)
 			{
-				entry->closeFile();
+				if (!closeEntryFile(entry))
+				{
+					// some parts are missing, it can't be resumed
+					QFile::remove(entry->fullPath);
+
+					processError(entry, tr("Unable to write %1").arg(entry->fullPath));
+
+					return;
+				}
 
 				if (entry->filesize)
 				{
@@ -1076,8 +2045,16 @@ void DownloadManager::onGetFinished()
 					}
 				}
 
+				// before being replaced by a link, date of the original file must not change
 				setFileModificationDate(entry->fullPath, entry->time);
 
+				Tracer::instant(entry->id, "modification time set");
+
+				if (!processChecksums(entry)) return;
+
+				// only complete files
+				syncEntryFile(*entry);
+
 				emit downloadSaved(*entry);
 			}
 			else
@@ -1091,12 +2068,17 @@ void DownloadManager::onGetFinished()
 			if (!data.isEmpty() && entry->count && entry->offset < entry->count)
 			{
 				// use same parameters
-				DownloadEntry* next = new DownloadEntry(*entry);
+				DownloadEntry next(*entry);
 
 				// increase offset
-				++next->offset;
+				++next.offset;
 
-				m_entries << next;
+				m_queue->append(next);
+			}
+			else
+			{
+				// last page, next ones are useless
+				abortPrefetches(*entry);
 			}
 
 			removeFromQueue(entry);
@@ -1113,7 +2095,7 @@ void DownloadManager::onGetFinished()
 		case 307:
 		case 308:
 		{
-			processRedirection(entry, redirection);
+			processRedirection(entry, redirection, statusCode);
 
 			break;
 		}
@@ -1151,12 +2133,11 @@ void DownloadManager::onHeadFinished()
 	QString acceptRanges = QString::fromLatin1(reply->rawHeader("Accept-Ranges"));
 	QString contentRange = QString::fromLatin1(reply->rawHeader("Content-Range"));
 
-	dumpHeaders(reply);
-	dumpCookies(url);
-
 	DownloadEntry* entry = findEntryByNetworkReply(reply);
 	Q_ASSERT(entry != nullptr);
 
+	processResponseFinished(entry, reply, statusCode);
+
 	entry->reply->deleteLater();
 	entry->reply = nullptr;
 
@@ -1165,6 +2146,8 @@ void DownloadManager::onHeadFinished()
 		if (error == QNetworkReply::UnknownNetworkError && !m_stopOnExpired)
 		{
 			// connection expired, retry
+			Metrics::increment("retries_total");
+
 			downloadNextFile();
 		}
 		else
@@ -1196,6 +2179,11 @@ void DownloadManager::onHeadFinished()
 				{
 					setFileModificationDate(entry->fullPath, lastModified);
 
+					Tracer::instant(entry->id, "modification time set");
+
+					// downloaded by a previous run
+					addCompleteFileToManifest(*entry);
+
 					emit downloadSaved(*entry);
 
 					removeFromQueue(entry);
@@ -1233,7 +2221,7 @@ void DownloadManager::onHeadFinished()
 		case 307:
 		case 308:
 		{
-			processRedirection(entry, redirection);
+			processRedirection(entry, redirection, statusCode);
 
 			break;
 		}
@@ -1253,6 +2241,11 @@ void DownloadManager::onPostFinished()
 	QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
 	Q_ASSERT(reply != nullptr);
 
+	processPostReply(reply);
+}
+
+void DownloadManager::processPostReply(QNetworkReply* reply)
+{
 	if (m_timerDownload->isActive()) m_timerDownload->stop();
 
 	int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
@@ -1266,6 +2259,10 @@ void DownloadManager::onPostFinished()
 
 	QByteArray data = reply->readAll();
 
+	m_statistics.bytes += data.size();
+
+	Metrics::increment("received_bytes_total", data.size());
+
 	// if data are still compressed (deflate ?), uncompress them
 	if (contentEncoding == "gzip" && !data.isEmpty() && data.at(0) == 0x1f)
 	{
@@ -1273,20 +2270,24 @@ void DownloadManager::onPostFinished()
 		data = Kervala::gUncompress(data);
 	}
 
-	dumpHeaders(reply);
-	dumpCookies(url);
-
 	DownloadEntry* entry = findEntryByNetworkReply(reply);
 	Q_ASSERT(entry != nullptr);
 
+	processResponseFinished(entry, reply, statusCode);
+
 	entry->reply->deleteLater();
 	entry->reply = nullptr;
 
 	if (error != QNetworkReply::NoError)
 	{
+		// connection of next pages is probably lost too, they'll be requested again
+		abortPrefetches(*entry);
+
 		if (error == QNetworkReply::UnknownNetworkError && !m_stopOnExpired)
 		{
 			// connection expired, retry
+			Metrics::increment("retries_total");
+
 			downloadNextFile();
 		}
 		else
@@ -1323,12 +2324,17 @@ void DownloadManager::onPostFinished()
 			if (!data.isEmpty() && entry->count && entry->offset < entry->count)
 			{
 				// use same parameters
-				DownloadEntry* next = new DownloadEntry(*entry);
+				DownloadEntry next(*entry);
 
 				// increase offset
-				++next->offset;
+				++next.offset;
 
-				m_entries << next;
+				m_queue->append(next);
+			}
+			else
+			{
+				// last page, next ones are useless
+				abortPrefetches(*entry);
 			}
 
 			removeFromQueue(entry);
@@ -1347,6 +2353,8 @@ void DownloadManager::onPostFinished()
 			// never redirect after posting data
 			emit downloadRedirected(redirection, *entry);
 
+			abortPrefetches(*entry);
+
 			removeFromQueue(entry);
 
 			downloadNextFile();
@@ -1363,45 +2371,3 @@ void DownloadManager::onPostFinished()
 		}
 	}
 }
-
-void DownloadManager::dumpHeaders(QNetworkReply *reply)
-{
-	QNetworkRequest request = reply->request();
-
-	qDebug() << "Request headers:";
-
-	QList<QByteArray> reqHeaders = request.rawHeaderList();
-
-	foreach(QByteArray reqName, reqHeaders)
-	{
-		QByteArray reqValue = request.rawHeader(reqName);
-		qDebug() << reqName << ": " << reqValue;
-	}
-
-	qDebug() << "Response headers:";
-
-	QList<QByteArray> headerList = reply->rawHeaderList();
-
-	foreach(QByteArray head, headerList)
-	{
-		qDebug() << head << ":" << reply->rawHeader(head);
-	}
-}
-
-void DownloadManager::dumpCookies(const QString &url)
-{
-	// somehow give reply a value
-	QNetworkCookieJar* cookiesJar = m_manager->cookieJar();
-
-	if (cookiesJar)
-	{
-		qDebug() << "Cookies headers:";
-
-		QList<QNetworkCookie> cookies = cookiesJar->cookiesForUrl(url);
-
-		foreach(const QNetworkCookie & cookie, cookies)
-		{
-			qDebug() << cookie.name() << ":" << cookie.value();
-		}
-	}
-}
@@ -23,7 +23,26 @@
 class QNetworkAccessManager;
 class QTimer;
 class QAuthenticator;
+class ContentStore;
+class FileWriter;
+class DownloadQueue;
+class RequestTemplate;
+class HarRecorder;
+class MirrorStats;
+class RedirectCache;
+class HostPrefetcher;
 struct DownloadEntry;
+struct DownloadEvent;
+
+// measured between start of the queue and its end
+struct DownloadStatistics
+{
+	int files; // finished downloads, successful or not
+	qint64 bytes; // received from network
+	qint64 elapsed; // in ms
+	qint64 cpuTime; // in ms
+	qint64 peakMemory; // in bytes
+};
 
 #ifndef COMMON_EXPORT
 #define COMMON_EXPORT
@@ -34,17 +53,36 @@ class COMMON_EXPORT DownloadManager : public QObject
 	Q_OBJECT
 
 public:
+	enum class Durability
+	{
+		None, // files are only flushed to system cache
+		File, // files are synced when completed
+		Directory // directories are also synced
+	};
+
 	DownloadManager(QObject* parent);
 	virtual ~DownloadManager();
 
 	int count() const;
 	bool isEmpty() const;
 
+	// return entry while it's in queue, else nullptr
+	const DownloadEntry* entry(int id) const;
+
 	bool saveFile(DownloadEntry *entry, const QByteArray& data);
 
 	bool download(const DownloadEntry &entry);
 	void downloadNextFile();
 
+	// batches with the highest priority are downloaded first, others share downloads according to their weight
+	int createBatch(int priority = 0, int weight = 1);
+	bool setBatchPriority(int batch, int priority, int weight = 1);
+	void pauseBatch(int batch);
+	void resumeBatch(int batch);
+
+	// remove waiting entries of a batch
+	void removeBatch(int batch);
+
 	void setUserAgent(const QString &userAgent);
 	void setProxy(const QString &proxy);
 
@@ -59,23 +97,56 @@ public:
 	void setStopOnError(bool stop = true);
 	void setStopOnExpired(bool stop = true);
 
+	// compute SHA-256 of downloaded files and save them in SHA256SUMS
+	void setChecksumManifest(bool enabled = true);
+
+	// compare downloaded files with MD5 embedded in URLs
+	void setVerifyChecksums(bool verify = true);
+
+	// link identical files instead of downloading or keeping them twice
+	void setDeduplicate(bool enabled = true);
+
+	void setDurability(Durability durability);
+
+	// number of AJAX pages requested in advance, they are still processed in order
+	void setPrefetchPages(int pages);
+
+	// record all requests and responses in an HTTP Archive, empty to disable
+	bool setHarFile(const QString& filename);
+
+	// performance of mirrors is kept in this file between sessions
+	void setMirrorStatsFile(const QString& filename);
+
+	// redirections are only kept during session if filename is empty
+	void setRedirectCacheFile(const QString& filename);
+
+	// resolve hosts of next entries and connect to the next one before it's requested
+	void setPrefetchHosts(bool enabled = true);
+
+	// throughput of last or current queue
+	DownloadStatistics statistics() const;
+
 signals:
 	void downloadQueued(const QString &file);
-	void downloadStarted(const DownloadEntry& entry);
-	void downloadStop(const DownloadEntry& entry);
+	void downloadStarted(const DownloadEvent& entry);
+	void downloadStop(const DownloadEvent& entry);
 	void downloadProgress(qint64 current, qint64 total, int speed); // speed is in kiB/s
 	void downloadCanceled(bool manually);
-	void downloadSucceeded(const QByteArray &data, const DownloadEntry &entry);
-	void downloadRedirected(const QString &url, const DownloadEntry& entry);
-	void downloadSaved(const DownloadEntry &entry);
+	void downloadSucceeded(const QByteArray &data, const DownloadEvent &entry);
+	void downloadRedirected(const QString &url, const DownloadEvent& entry);
+	void downloadSaved(const DownloadEvent &entry);
 
-	void downloadInfo(const QString& info, const DownloadEntry& entry);
-	void downloadError(const QString& error, const DownloadEntry& entry);
-	void downloadWarning(const QString& warning, const DownloadEntry& entry);
+	void downloadInfo(const QString& info, const DownloadEvent& entry);
+	void downloadError(const QString& error, const DownloadEvent& entry);
+	void downloadFailed(const DownloadEvent& entry); // after all retries and mirrors
+	void downloadWarning(const QString& warning, const DownloadEvent& entry);
 
 	void queueStarted(int total);
 	void queueProgress(int current, int total);
 	void queueFinished(bool aborted);
+
+	void batchProgress(int batch, int done, int total);
+	void batchFinished(int batch);
 	
 	void authorizationFailed(const QString& url, const QByteArray &data);
 
@@ -96,36 +167,96 @@ public slots:
 	void onReplyError(QNetworkReply::NetworkError error);
 	void onTimeout();
 	void onMetaDataChanged();
+	void onWriterAvailable();
 
 private:
 	QString redirectUrl(const QString &newUrl, const QString &oldUrl) const;
 	bool downloadEntry(DownloadEntry *entry);
 
+	void processGetReply(QNetworkReply* reply);
+	void processPostReply(QNetworkReply* reply);
+
+	bool isPage(const DownloadEntry& entry) const;
+	QString pageKey(const DownloadEntry& entry, int offset) const;
+	void prefetchPages(const DownloadEntry& entry);
+	bool adoptPrefetch(DownloadEntry* entry);
+	void abortPrefetches(const DownloadEntry& entry);
+	void prefetchHosts(const DownloadEntry& entry);
+
+	void appendEntry(DownloadEntry* entry);
+	void deleteEntry(DownloadEntry* entry);
+	DownloadEntry* acquireEntry();
+	void releaseEntry(DownloadEntry* entry);
+
 	DownloadEntry* findEntry(const DownloadEntry &entry) const;
+	void processBatchProgress(int batch);
+	void finishEmptyBatches();
+	void updateStatistics();
+	void updateMetrics();
+	void processResponseFinished(DownloadEntry* entry, QNetworkReply* reply, int statusCode);
 	DownloadEntry* findEntryByNetworkReply(QNetworkReply *reply) const;
 
-	void dumpHeaders(QNetworkReply* reply);
-	void dumpCookies(const QString &url);
-
-	void processRedirection(DownloadEntry* entry, const QString& newUrl);
+	void processRedirection(DownloadEntry* entry, const QString& newUrl, int statusCode);
+	void setEntryUrl(DownloadEntry* entry, const QString& url);
+	void selectMirror(DownloadEntry* entry);
+	bool switchMirror(DownloadEntry* entry, const QString& error);
+	void applyCachedRedirection(DownloadEntry* entry);
+	bool revertCachedRedirection(DownloadEntry* entry, const QString& error);
 	void processError(DownloadEntry* entry, const QString& error);
 	void processContentDisposition(DownloadEntry* entry, const QString& contentDisposition);
 	void processAcceptRanges(DownloadEntry* entry, const QString& acceptRanges);
 	void processContentRange(DownloadEntry* entry, const QString& contentRange, qint64 contentLength);
 
 	bool checkEntryFileOffset(DownloadEntry* entry);
+	bool closeEntryFile(DownloadEntry* entry);
+	void writeReplyData(DownloadEntry* entry, QNetworkReply* reply);
+	void syncEntryFile(const DownloadEntry& entry);
+
+	void initEntryHashes(DownloadEntry* entry);
+	bool processChecksums(DownloadEntry* entry);
+	QSet<QString>& manifestFiles(const QString& directory);
+	bool updateChecksumManifest(const QString& fullPath, const QByteArray& sha256);
+	void addCompleteFileToManifest(const DownloadEntry& entry);
+	bool processDuplicate(DownloadEntry* entry, const QByteArray& sha256, bool checksumVerified);
+	bool linkDuplicate(DownloadEntry* entry);
 
 	QNetworkAccessManager *m_manager;
 	bool m_mustStop;
+	bool m_running;
 	bool m_stopOnError;
 	bool m_stopOnExpired;
-	QList<DownloadEntry*> m_entries;
-	QString m_userAgent;
+	bool m_checksumManifest;
+	bool m_verifyChecksums;
+	QHash<QString, QSet<QString> > m_manifestFiles; // directory to names already in its manifest
+	ContentStore *m_contentStore;
+	Durability m_durability;
+	QList<DownloadEntry*> m_entries; // being downloaded
+	DownloadQueue *m_queue; // waiting
+	QVector<DownloadEntry*> m_freeEntries; // deleted entries kept to be reused
+	QHash<int, DownloadEntry*> m_entriesById;
+	QMultiHash<QString, DownloadEntry*> m_entriesByUrl;
+	QByteArray m_userAgent;
+	RequestTemplate *m_requestTemplate; // for last batch
+	int m_prefetchPages;
+	QHash<QString, QNetworkReply*> m_prefetches; // AJAX pages requested in advance
+	QList<QPointer<QNetworkReply> > m_waitingReplies; // not read while disk is busy
 	QTimer *m_timerConnection;
 	QTimer *m_timerDownload;
 	QNetworkProxy m_proxy;
 
 	int m_queueInitialSize;
+	DownloadStatistics m_statistics;
+	QElapsedTimer m_queueTimer;
+	qint64 m_queueCpuTime; // when queue started
+	int m_lastEntryId;
+
+	FileWriter *m_writer;
+	HarRecorder *m_har; // only when enabled
+	QString m_harFilename;
+	MirrorStats *m_mirrorStats;
+	RedirectCache *m_redirects;
+	HostPrefetcher *m_hostPrefetcher;
+	bool m_prefetchHosts;
 };
 
 #endif
@@ -0,0 +1,492 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "downloadqueue.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// virtual time used by a batch with a weight of 1 for each download
+#define STRIDE 65536
+
+bool DownloadQueue::Key::operator < (const Key& other) const
+{
+	// highest priority first
+	if (priority != other.priority) return priority > other.priority;
+
+	// then batch which used the less its share
+	if (pass != other.pass) return pass < other.pass;
+
+	// then oldest batch
+	return id < other.id;
+}
+
+DownloadQueue::DownloadQueue():m_size(0), m_lastBatchId(0), m_pass(0)
+{
+}
+
+DownloadQueue::~DownloadQueue()
+{
+}
+
+int DownloadQueue::size() const
+{
+	return m_size;
+}
+
+bool DownloadQueue::isEmpty() const
+{
+	return m_size == 0;
+}
+
+int DownloadQueue::createBatch(int priority, int weight)
+{
+	Batch& b = batch(++m_lastBatchId);
+	b.priority = priority;
+	b.weight = qMax(weight, 1);
+
+	return b.id;
+}
+
+DownloadQueue::Batch& DownloadQueue::batch(int id)
+{
+	QHash<int, Batch>::iterator it = m_batches.find(id);
+
+	if (it != m_batches.end()) return it.value();
+
+	// create it with default values
+	Batch& b = m_batches[id];
+	b.id = id;
+	b.pass = m_pass;
+
+	if (id > m_lastBatchId) m_lastBatchId = id;
+
+	return b;
+}
+
+DownloadQueue::Key DownloadQueue::key(const Batch& batch) const
+{
+	Key k;
+	k.priority = batch.priority;
+	k.pass = batch.pass;
+	k.id = batch.id;
+
+	return k;
+}
+
+bool DownloadQueue::isBefore(const Position& a, const Position& b) const
+{
+	if (a.batch == b.batch) return a.index < b.index;
+
+	// batches are processed in the order of their keys
+	return key(*m_batches.constFind(a.batch)) < key(*m_batches.constFind(b.batch));
+}
+
+void DownloadQueue::schedule(Batch& batch)
+{
+	if (batch.paused || batch.size == 0) return;
+
+	Key k = key(batch);
+
+	if (m_ready.contains(k)) return;
+
+	// don't let a batch which was waiting get all downloads to catch up
+	if (batch.pass < m_pass)
+	{
+		batch.pass = m_pass;
+		k.pass = m_pass;
+	}
+
+	m_ready.insert(k, batch.id);
+}
+
+void DownloadQueue::unschedule(const Batch& batch)
+{
+	m_ready.remove(key(batch));
+}
+
+bool DownloadQueue::setBatchPriority(int id, int priority, int weight)
+{
+	if (!m_batches.contains(id)) return false;
+
+	Batch& b = batch(id);
+
+	unschedule(b);
+
+	b.priority = priority;
+	b.weight = qMax(weight, 1);
+
+	schedule(b);
+
+	return true;
+}
+
+bool DownloadQueue::setBatchPaused(int id, bool paused)
+{
+	if (!m_batches.contains(id)) return false;
+
+	Batch& b = batch(id);
+
+	if (b.paused == paused) return true;
+
+	unschedule(b);
+
+	b.paused = paused;
+
+	schedule(b);
+
+	return true;
+}
+
+bool DownloadQueue::isBatchPaused(int id) const
+{
+	QHash<int, Batch>::const_iterator it = m_batches.constFind(id);
+
+	return it != m_batches.constEnd() && it.value().paused;
+}
+
+bool DownloadQueue::isBatchFinished(int id) const
+{
+	QHash<int, Batch>::const_iterator it = m_batches.constFind(id);
+
+	return it != m_batches.constEnd() && it.value().size == 0 && it.value().done >= it.value().total;
+}
+
+QList<int> DownloadQueue::finishedBatches() const
+{
+	QList<int> ids;
+
+	for (QHash<int, Batch>::const_iterator it = m_batches.constBegin(); it != m_batches.constEnd(); ++it)
+	{
+		if (it.value().size == 0 && it.value().done >= it.value().total) ids << it.key();
+	}
+
+	return ids;
+}
+
+bool DownloadQueue::batchProgress(int id, int& done, int& total) const
+{
+	QHash<int, Batch>::const_iterator it = m_batches.constFind(id);
+
+	if (it == m_batches.constEnd()) return false;
+
+	done = it.value().done;
+	total = it.value().total;
+
+	return true;
+}
+
+void DownloadQueue::removeBatch(int id)
+{
+	QHash<int, Batch>::iterator it = m_batches.find(id);
+
+	if (it == m_batches.end()) return;
+
+	Batch& b = it.value();
+
+	unschedule(b);
+
+	// remove positions of waiting items
+	for (int i = b.first; i < b.items.size(); ++i)
+	{
+		const Item& item = b.items[i];
+
+		if (item.common < 0) continue;
+
+		QMultiHash<QString, Position>::iterator pit = m_positions.find(item.url);
+
+		while (pit != m_positions.end() && pit.key() == item.url)
+		{
+			if (pit.value().batch == id)
+			{
+				pit = m_positions.erase(pit);
+			}
+			else
+			{
+				++pit;
+			}
+		}
+	}
+
+	m_size -= b.size;
+
+	m_batches.erase(it);
+}
+
+int DownloadQueue::commonIndex(Batch& batch, const DownloadEntry& entry, int directoryLength)
+{
+	// entries of a same batch are appended together, only compare with last one
+	if (!batch.commons.isEmpty())
+	{
+		const Common& common = batch.commons.last();
+
+		if (common.method == entry.method && common.type == entry.type && common.count == entry.count &&
+			common.directory.length() == directoryLength && entry.fullPath.startsWith(common.directory) &&
+			common.offsetParameter == entry.offsetParameter && common.countParameter == entry.countParameter &&
+			common.headers == entry.headers && common.parameters == entry.parameters && common.data == entry.data)
+		{
+			return batch.commons.size() - 1;
+		}
+	}
+
+	Common common;
+	common.method = entry.method;
+	common.type = entry.type;
+	common.count = entry.count;
+	common.referer = entry.referer;
+	common.directory = entry.fullPath.left(directoryLength);
+	common.headers = entry.headers;
+	common.parameters = entry.parameters;
+	common.offsetParameter = entry.offsetParameter;
+	common.countParameter = entry.countParameter;
+	common.data = entry.data;
+
+	batch.commons << common;
+
+	return batch.commons.size() - 1;
+}
+
+void DownloadQueue::append(const DownloadEntry& entry)
+{
+	Batch& b = batch(entry.batch);
+
+	// length of directory if full path is directory + "/" + filename
+	int directoryLength = entry.fullPath.length() - entry.filename.length() - 1;
+
+	bool splitPath = !entry.filename.isEmpty() && directoryLength > 0 && entry.fullPath.at(directoryLength) == '/' && entry.fullPath.endsWith(entry.filename);
+
+	if (!splitPath) directoryLength = 0;
+
+	Item item;
+	item.common = commonIndex(b, entry, directoryLength);
+	item.offset = entry.offset;
+	item.url = entry.url;
+	item.filename = entry.filename;
+	item.checksum = entry.checksum;
+	item.mirrors = entry.mirrors;
+
+	if (!splitPath) item.fullPath = entry.fullPath;
+
+	// an empty but not null string is used when entry has no referer
+	if (entry.referer != b.commons[item.common].referer) item.referer = entry.referer.isNull() ? QString("") : entry.referer;
+
+	Position position;
+	position.batch = b.id;
+	position.index = b.base + b.items.size();
+
+	m_positions.insert(item.url, position);
+
+	b.items << item;
+
+	++b.size;
+	++b.total;
+	++m_size;
+
+	// batch was empty
+	if (b.size == 1) schedule(b);
+}
+
+bool DownloadQueue::matches(const Batch& batch, const Item& item, const DownloadEntry& entry) const
+{
+	if (item.common < 0) return false;
+
+	const Common& common = batch.commons[item.common];
+
+	// same comparison as DownloadEntry::operator ==
+	return item.url == entry.url && common.method == entry.method && common.parameters == entry.parameters && item.offset == entry.offset && common.count == entry.count;
+}
+
+bool DownloadQueue::contains(const DownloadEntry& entry) const
+{
+	QMultiHash<QString, Position>::const_iterator it = m_positions.constFind(entry.url);
+
+	while (it != m_positions.constEnd() && it.key() == entry.url)
+	{
+		const Batch& b = *m_batches.constFind(it.value().batch);
+
+		if (matches(b, b.items[it.value().index - b.base], entry)) return true;
+
+		++it;
+	}
+
+	return false;
+}
+
+int DownloadQueue::remove(const QString& url)
+{
+	QMultiHash<QString, Position>::iterator it = m_positions.find(url);
+
+	if (it == m_positions.end()) return -1;
+
+	// hash returns the last inserted position first, remove the one which would be downloaded first
+	QMultiHash<QString, Position>::iterator next = it;
+
+	for (++next; next != m_positions.end() && next.key() == url; ++next)
+	{
+		if (isBefore(next.value(), it.value())) it = next;
+	}
+
+	Batch& b = batch(it.value().batch);
+	Item& item = b.items[it.value().index - b.base];
+
+	m_positions.erase(it);
+
+	// only mark it as removed, it will be skipped
+	item = Item();
+
+	--b.size;
+	--b.total;
+	--m_size;
+
+	if (b.size == 0)
+	{
+		unschedule(b);
+		release(b);
+	}
+
+	return b.id;
+}
+
+void DownloadQueue::clear()
+{
+	m_batches.clear();
+	m_ready.clear();
+	m_positions.clear();
+
+	m_size = 0;
+	m_pass = 0;
+}
+
+void DownloadQueue::addActive(int id)
+{
+	++batch(id).total;
+}
+
+void DownloadQueue::finish(int id)
+{
+	QHash<int, Batch>::iterator it = m_batches.find(id);
+
+	if (it != m_batches.end()) ++it.value().done;
+}
+
+void DownloadQueue::release(Batch& batch)
+{
+	batch.base += batch.items.size();
+	batch.first = 0;
+
+	// nothing left, also release shared fields
+	batch.commons.clear();
+	batch.items.clear();
+}
+
+void DownloadQueue::compact(Batch& batch)
+{
+	batch.items.remove(0, batch.first);
+
+	batch.base += batch.first;
+	batch.first = 0;
+}
+
+QVector<QStringList> DownloadQueue::nextUrls(int count) const
+{
+	QVector<QStringList> urls;
+
+	if (m_ready.isEmpty()) return urls;
+
+	const Batch& b = *m_batches.constFind(m_ready.first());
+
+	for (int i = b.first; i < b.items.size() && urls.size() < count; ++i)
+	{
+		// skip removed items
+		if (b.items[i].common > -1) urls << (QStringList(b.items[i].url) + b.items[i].mirrors);
+	}
+
+	return urls;
+}
+
+bool DownloadQueue::takeFirst(DownloadEntry& entry)
+{
+	if (m_ready.isEmpty()) return false;
+
+	Batch& b = batch(m_ready.first());
+
+	unschedule(b);
+
+	// skip removed items
+	while (b.first < b.items.size() && b.items[b.first].common < 0) ++b.first;
+
+	Item& item = b.items[b.first];
+	const Common& common = b.commons[item.common];
+
+	entry.batch = b.id;
+	entry.url = item.url;
+	entry.filename = item.filename;
+	entry.referer = item.referer.isNull() ? common.referer : item.referer;
+	entry.method = common.method;
+	entry.headers = common.headers;
+	entry.parameters = common.parameters;
+	entry.offset = item.offset;
+	entry.offsetParameter = common.offsetParameter;
+	entry.count = common.count;
+	entry.countParameter = common.countParameter;
+	entry.type = common.type;
+	entry.data = common.data;
+	entry.fullPath = item.fullPath.isNull() && !common.directory.isEmpty() ? common.directory + "/" + item.filename : item.fullPath;
+	entry.checksum = item.checksum;
+	entry.mirrors = item.mirrors;
+
+	QMultiHash<QString, Position>::iterator it = m_positions.find(item.url);
+
+	while (it != m_positions.end() && it.key() == item.url)
+	{
+		if (it.value().batch == b.id && it.value().index == b.base + b.first)
+		{
+			m_positions.erase(it);
+			break;
+		}
+
+		++it;
+	}
+
+	// release strings now
+	item = Item();
+
+	++b.first;
+	--b.size;
+	--m_size;
+
+	// use its share
+	m_pass = b.pass;
+	b.pass += STRIDE / b.weight;
+
+	if (b.size == 0)
+	{
+		release(b);
+	}
+	else
+	{
+		if (b.first > 1024 && b.first > b.items.size() / 2) compact(b);
+
+		schedule(b);
+	}
+
+	return true;
+}
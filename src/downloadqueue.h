@@ -0,0 +1,173 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DOWNLOADQUEUE_H
+#define DOWNLOADQUEUE_H
+
+#include "downloadentry.h"
+
+// compact storage of entries waiting to be downloaded, fields shared by consecutive
+// entries (headers, parameters, directory, etc...) are only stored once and a full
+// DownloadEntry is only created when it's about to be downloaded
+// progress fields (offsets, sizes, dates, etc...) are not kept
+//
+// entries are grouped by batches, the batch with the highest priority is always
+// processed first and batches with the same priority share the downloads according
+// to their weight (a batch with a weight of 2 gets twice more downloads)
+class DownloadQueue
+{
+public:
+	DownloadQueue();
+	~DownloadQueue();
+
+	int size() const;
+	bool isEmpty() const;
+
+	// entries of an unknown batch are added to a new batch with default values
+	int createBatch(int priority, int weight);
+	bool setBatchPriority(int batch, int priority, int weight);
+	bool setBatchPaused(int batch, bool paused);
+	bool isBatchPaused(int batch) const;
+	bool isBatchFinished(int batch) const;
+
+	// IDs of finished batches, including the ones which never received any entry
+	QList<int> finishedBatches() const;
+	bool batchProgress(int batch, int& done, int& total) const;
+
+	// remove the batch and all its waiting entries
+	void removeBatch(int batch);
+
+	void append(const DownloadEntry& entry);
+	bool contains(const DownloadEntry& entry) const;
+	void clear();
+
+	// return the batch of removed entry, -1 if not found
+	int remove(const QString& url);
+
+	// entry of batch downloaded without being queued
+	void addActive(int batch);
+
+	// entry of batch downloaded or failed
+	void finish(int batch);
+
+	// fill a full entry with the next item to download, returns false if all batches are empty or paused
+	bool takeFirst(DownloadEntry& entry);
+
+	// URLs of next items of the batch which will be downloaded next, without taking them,
+	// each one is followed by its mirrors
+	QVector<QStringList> nextUrls(int count) const;
+
+private:
+	// fields shared by all entries of a batch
+	struct Common
+	{
+		DownloadEntry::Method method;
+		int type;
+		int count;
+		QString referer;
+		QString directory;
+		QMap<QString, QString> headers;
+		QMap<QString, QString> parameters;
+		QString offsetParameter;
+		QString countParameter;
+		QString data;
+	};
+
+	// fields specific to each entry, optional strings are null when common ones are used
+	struct Item
+	{
+		Item():common(-1), offset(0)
+		{
+		}
+
+		int common; // index in Batch::commons, -1 if removed
+		int offset;
+		QString url;
+		QString filename;
+		QString referer; // optional
+		QString fullPath; // optional, else directory + filename
+		QString checksum; // optional
+		QStringList mirrors; // optional
+	};
+
+	struct Batch
+	{
+		Batch():id(0), priority(0), weight(1), paused(false), pass(0), first(0), size(0), base(0), total(0), done(0)
+		{
+		}
+
+		int id;
+		int priority; // highest first
+		int weight; // share between batches with same priority
+		bool paused;
+		qint64 pass; // virtual time of next download, lowest first
+
+		QVector<Common> commons;
+		QVector<Item> items;
+
+		int first; // first item not taken
+		int size; // items not taken nor removed
+		qint64 base; // absolute position of items[0]
+
+		int total; // all entries, including the ones already downloaded
+		int done; // entries downloaded or failed
+	};
+
+	// order of batches ready to be processed
+	struct Key
+	{
+		int priority;
+		qint64 pass;
+		int id;
+
+		bool operator < (const Key& other) const;
+	};
+
+	// position of an item in queue
+	struct Position
+	{
+		int batch;
+		qint64 index;
+	};
+
+	Batch& batch(int id);
+	Key key(const Batch& batch) const;
+	bool isBefore(const Position& a, const Position& b) const;
+	void schedule(Batch& batch);
+	void unschedule(const Batch& batch);
+
+	int commonIndex(Batch& batch, const DownloadEntry& entry, int directoryLength);
+	bool matches(const Batch& batch, const Item& item, const DownloadEntry& entry) const;
+	void compact(Batch& batch);
+	void release(Batch& batch);
+
+	QHash<int, Batch> m_batches;
+
+	// batches not paused and not empty
+	QMap<Key, int> m_ready;
+
+	// URL to position in queue, used to find duplicates
+	QMultiHash<QString, Position> m_positions;
+
+	int m_size; // items of all batches
+	int m_lastBatchId;
+	qint64 m_pass; // virtual time of last download
+};
+
+#endif
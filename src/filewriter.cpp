@@ -0,0 +1,353 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "filewriter.h"
+#include "functions.h"
+#include "metrics.h"
+
+#ifndef Q_OS_WIN32
+	#include <sys/uio.h>
+	#include <errno.h>
+#endif
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// maximum number of buffers kept for reuse
+#define MAX_RECYCLED_BUFFERS 32
+
+// maximum number of buffers written with one call to writev
+#define MAX_IOVEC 64
+
+// network is slowed down when disk is slower
+#define MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+// network is resumed when pending data fall below this size
+#define RESUME_PENDING_BYTES (MAX_PENDING_BYTES / 2)
+
+FileWriter::FileWriter(QObject* parent):QThread(parent), m_pendingBytes(0), m_busy(false), m_stop(false)
+{
+	start();
+}
+
+FileWriter::~FileWriter()
+{
+	{
+		QMutexLocker locker(&m_mutex);
+
+		m_stop = true;
+
+		m_operationsAdded.wakeAll();
+	}
+
+	// pending operations are processed before leaving
+	wait();
+}
+
+QByteArray FileWriter::takeBuffer(qint64 size)
+{
+	// small chunks don't keep a large capacity while waiting
+	if (size < BufferSize) return QByteArray((int)qMax(size, (qint64)1), Qt::Uninitialized);
+
+	QByteArray buffer;
+
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if (!m_buffers.isEmpty()) buffer = m_buffers.takeLast();
+	}
+
+	buffer.resize(BufferSize);
+
+	return buffer;
+}
+
+void FileWriter::write(const QSharedPointer<QFile>& file, const QByteArray& data)
+{
+	if (data.isEmpty() || !file) return;
+
+	{
+		QMutexLocker locker(&m_mutex);
+
+		// callers stop reading network while busy
+		m_pendingBytes += data.size();
+	}
+
+	append(Operation::Type::Write, file, data);
+}
+
+void FileWriter::close(const QSharedPointer<QFile>& file)
+{
+	append(Operation::Type::Close, file, QByteArray());
+}
+
+void FileWriter::syncFile(const QString& filename)
+{
+	QMutexLocker locker(&m_mutex);
+
+	m_files << filename;
+
+	m_operationsAdded.wakeAll();
+}
+
+void FileWriter::syncDirectory(const QString& directory)
+{
+	QMutexLocker locker(&m_mutex);
+
+	m_directories << directory;
+
+	m_operationsAdded.wakeAll();
+}
+
+void FileWriter::waitForFile(const QSharedPointer<QFile>& file)
+{
+	QMutexLocker locker(&m_mutex);
+
+	while (m_pending.contains(file.data()))
+	{
+		m_operationsProcessed.wait(&m_mutex);
+	}
+}
+
+bool FileWriter::isBusy()
+{
+	QMutexLocker locker(&m_mutex);
+
+	if (m_pendingBytes <= MAX_PENDING_BYTES) return false;
+
+	m_busy = true;
+
+	return true;
+}
+
+bool FileWriter::takeError(const QSharedPointer<QFile>& file)
+{
+	QMutexLocker locker(&m_mutex);
+
+	return m_errors.remove(file.data());
+}
+
+void FileWriter::append(Operation::Type type, const QSharedPointer<QFile>& file, const QByteArray& data)
+{
+	if (!file) return;
+
+	Operation operation;
+	operation.type = type;
+	operation.file = file;
+	operation.data = data;
+
+	QMutexLocker locker(&m_mutex);
+
+	m_operations << operation;
+
+	++m_pending[file.data()];
+
+	m_operationsAdded.wakeAll();
+}
+
+void FileWriter::run()
+{
+	Operations operations;
+	QSet<QString> files;
+	QSet<QString> directories;
+	QSet<QFile*> failed;
+
+	forever
+	{
+		{
+			QMutexLocker locker(&m_mutex);
+
+			while (m_operations.isEmpty() && m_files.isEmpty() && m_directories.isEmpty() && !m_stop)
+			{
+				m_operationsAdded.wait(&m_mutex);
+			}
+
+			if (m_operations.isEmpty() && m_files.isEmpty() && m_directories.isEmpty()) return;
+
+			// take all pending operations at once
+			operations.swap(m_operations);
+			files.swap(m_files);
+			directories.swap(m_directories);
+		}
+
+		process(operations, failed);
+
+		bool available = false;
+
+		{
+			QMutexLocker locker(&m_mutex);
+
+			m_errors.unite(failed);
+
+			for (const Operation& operation : operations)
+			{
+				QHash<QFile*, int>::iterator it = m_pending.find(operation.file.data());
+
+				if (it != m_pending.end() && --it.value() < 1) m_pending.erase(it);
+
+				if (operation.type != Operation::Type::Write) continue;
+
+				m_pendingBytes -= operation.data.size();
+
+				if (m_buffers.size() < MAX_RECYCLED_BUFFERS && operation.data.capacity() >= BufferSize)
+				{
+					m_buffers << operation.data;
+				}
+			}
+
+			if (m_busy && m_pendingBytes <= RESUME_PENDING_BYTES)
+			{
+				m_busy = false;
+
+				available = true;
+			}
+
+			// don't make them wait for syncs
+			m_operationsProcessed.wakeAll();
+		}
+
+		// received in thread of readers
+		if (available) emit this->available();
+
+		operations.clear();
+		failed.clear();
+
+		// files were closed before, sync them after writes and before their directories
+		for (const QString& filename : files)
+		{
+			QFile file(filename);
+
+			if (!file.open(QFile::ReadWrite | QFile::Append) || !::syncFile(&file))
+			{
+				qWarning() << "Unable to sync" << filename;
+			}
+		}
+
+		for (const QString& directory : directories)
+		{
+			if (!::syncDirectory(directory))
+			{
+				qWarning() << "Unable to sync" << directory;
+			}
+		}
+
+		files.clear();
+		directories.clear();
+	}
+}
+
+static bool writeBuffers(QFile* file, const QByteArray* const* buffers, int count)
+{
+#ifdef Q_OS_WIN32
+	for (int i = 0; i < count; ++i)
+	{
+		if (file->write(*buffers[i]) != buffers[i]->size()) return false;
+	}
+
+	return true;
+#else
+	struct iovec iov[MAX_IOVEC];
+
+	for (int i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = const_cast<char*>(buffers[i]->constData());
+		iov[i].iov_len = buffers[i]->size();
+	}
+
+	int index = 0;
+
+	while (index < count)
+	{
+		ssize_t res = ::writev(file->handle(), iov + index, count - index);
+
+		if (res < 0)
+		{
+			if (errno == EINTR) continue;
+
+			return false;
+		}
+
+		// skip buffers written, partially or not
+		while (index < count && res >= (ssize_t)iov[index].iov_len)
+		{
+			res -= iov[index].iov_len;
+			++index;
+		}
+
+		if (index < count)
+		{
+			iov[index].iov_base = (char*)iov[index].iov_base + res;
+			iov[index].iov_len -= res;
+		}
+	}
+
+	return true;
+#endif
+}
+
+void FileWriter::process(Operations& operations, QSet<QFile*>& failed)
+{
+	const QByteArray* buffers[MAX_IOVEC];
+
+	for (int i = 0, len = operations.size(); i < len; ++i)
+	{
+		Operation& operation = operations[i];
+
+		QFile* file = operation.file.data();
+
+		if (!file->isOpen()) continue;
+
+		switch (operation.type)
+		{
+		case Operation::Type::Write:
+		{
+			int count = 0;
+
+			buffers[count++] = &operation.data;
+
+			// merge next writes to the same file
+			while (count < MAX_IOVEC && i + 1 < len && operations[i + 1].type == Operation::Type::Write && operations[i + 1].file == operation.file)
+			{
+				buffers[count++] = &operations[++i].data;
+			}
+
+			QElapsedTimer timer;
+			timer.start();
+
+			// disk full, reported when file is closed
+			if (!writeBuffers(file, buffers, count))
+			{
+				qWarning() << "Unable to write" << file->fileName();
+
+				failed << file;
+			}
+
+			Metrics::observe("file_write_seconds", (double)timer.nsecsElapsed() / 1000000000.0);
+
+			break;
+		}
+
+		case Operation::Type::Close:
+			file->close();
+			break;
+		}
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+// write files in a separate thread so the network is never blocked by disk,
+// all pending operations are processed together and consecutive writes
+// to the same file are merged in a single system call
+class FileWriter : public QThread
+{
+	Q_OBJECT
+
+public:
+	FileWriter(QObject* parent);
+	virtual ~FileWriter();
+
+	// maximum size of buffers returned by takeBuffer()
+	enum { BufferSize = 256 * 1024 };
+
+	// return a buffer of size bytes (BufferSize at most), buffers of BufferSize
+	// bytes are recycled to avoid allocations
+	QByteArray takeBuffer(qint64 size);
+
+	// files must be opened unbuffered, never blocks
+	void write(const QSharedPointer<QFile>& file, const QByteArray& data);
+	void close(const QSharedPointer<QFile>& file);
+
+	// closed files and then directories are synced in groups after pending operations,
+	// nobody waits for them
+	void syncFile(const QString& filename);
+	void syncDirectory(const QString& directory);
+
+	// block until all operations on file are processed
+	void waitForFile(const QSharedPointer<QFile>& file);
+
+	// too many data are waiting for disk, available() will be emitted when most of them are written
+	bool isBusy();
+
+	// return true if a write to file failed and forget it, call it after waitForFile()
+	bool takeError(const QSharedPointer<QFile>& file);
+
+signals:
+	void available();
+
+protected:
+	virtual void run();
+
+private:
+	struct Operation
+	{
+		enum class Type
+		{
+			Write,
+			Close
+		};
+
+		Type type;
+		QSharedPointer<QFile> file;
+		QByteArray data;
+	};
+
+	typedef QVector<Operation> Operations;
+
+	void append(Operation::Type type, const QSharedPointer<QFile>& file, const QByteArray& data);
+	void process(Operations& operations, QSet<QFile*>& failed);
+
+	QMutex m_mutex;
+	QWaitCondition m_operationsAdded;
+	QWaitCondition m_operationsProcessed;
+
+	Operations m_operations;
+	QHash<QFile*, int> m_pending;
+	qint64 m_pendingBytes; // data not written yet
+	bool m_busy; // available() must be emitted
+	QSet<QFile*> m_errors; // files with a failed write
+	QVector<QByteArray> m_buffers;
+	QSet<QString> m_files;
+	QSet<QString> m_directories;
+
+	bool m_stop;
+};
+
+#endif
@@ -22,12 +22,19 @@
 
 #ifdef Q_OS_WIN32
 	#include <windows.h>
+	#include <io.h>
 #elif defined(Q_OS_MAC)
 	#include <sys/mount.h>
 	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #else
 	#include <sys/vfs.h>
 	#include <sys/stat.h>
+	#include <sys/ioctl.h>
+	#include <linux/fs.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #endif
 
 #define USE_JPEGCHECKER
@@ -294,73 +301,226 @@ bool parseUrl(const QString &url, QString *basename, QString *ext)
 	return true;
 }
 
+static inline bool isLowerHexDigit(QChar c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
 QString getChecksumFromUrl(const QString& url)
 {
 	// https://c10.patreonusercontent.com/3/eyJwIjoxfQ%3D%3D/patreon-media/p/post/41522731/005fcd89d29e42718988a147b7da83d2/1.jpg
 
-	QRegularExpression reg("/([a-f0-9]{32})/");
+	// same as regular expression "/([a-f0-9]{32})/"
+	int pos = url.indexOf('/');
 
-	QRegularExpressionMatch match = reg.match(url);
-
-	if (match.hasMatch())
+	while (pos > -1 && pos + 33 < url.length())
 	{
-		return match.captured(1);
+		int i = 1;
+
+		while (i <= 32 && isLowerHexDigit(url[pos + i])) ++i;
+
+		if (i == 33 && url[pos + 33] == '/') return url.mid(pos + 1, 32);
+
+		// next slash
+		pos = url.indexOf('/', pos + i);
 	}
 
 	return QString();
 }
 
+// characters replaced by spaces: \n \r \ / : * $ ? " < > |
+static const bool s_invalidFilenameCharacters[128] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0
+};
+
+static inline bool isInvalidFilenameCharacter(ushort c)
+{
+	// characters above 1000 are also replaced
+	return c < 128 ? s_invalidFilenameCharacters[c] : c > 1000;
+}
+
 QString fixFilename(const QString& filename)
 {
-	QString tmp = filename;
+	const QChar* src = filename.constData();
+	int length = filename.length();
 
-	// replace invalid characters by spaces
-	tmp.replace(QRegularExpression("[" + QRegularExpression::escape("\n\r\\/:*$?\"<>|") + "]"), QString(" "));
+	// dots at the end are also replaced by spaces
+	int dotsPos = length;
 
-	for (int i = 0; i < tmp.size(); ++i)
+	while (dotsPos > 0 && src[dotsPos - 1] == '.') --dotsPos;
+
+	// search first character to change, usually none
+	int pos = 0;
+
+	while (pos < dotsPos)
 	{
-		ushort c = tmp[i].unicode();
+		ushort c = src[pos].unicode();
 
-		if (c > 1000)
-		{
-			tmp[i] = ' ';
-		}
+		if (isInvalidFilenameCharacter(c) || (c == ' ' && pos + 1 < length && src[pos + 1] == ' ')) break;
+
+		++pos;
 	}
 
-	// remove all dots from the end
-	for (int i = tmp.size() - 1; i >= 0; --i)
+	// filename is already valid, share it
+	if (pos == length && length <= 100) return filename.trimmed();
+
+	QString tmp(length, Qt::Uninitialized);
+	QChar* dst = tmp.data();
+
+	// copy valid part
+	memcpy(dst, src, pos * sizeof(QChar));
+
+	int len = pos;
+
+	// replace invalid characters by spaces and replace several spaces by one in a single pass
+	for (; pos < length; ++pos)
 	{
-		ushort c = tmp[i].unicode();
+		ushort c = src[pos].unicode();
 
-		if (c != '.') break;
+		if (pos >= dotsPos || isInvalidFilenameCharacter(c)) c = ' ';
 
-		tmp[i] = ' ';
-	}
+		if (c == ' ' && len > 0 && dst[len - 1] == ' ') continue;
 
-	// replace several spaces by one
-	tmp.replace(QRegularExpression(" +"), QString(" "));
+		dst[len++] = QChar(c);
+	}
 
 	// maximum 100 characters
-	if (tmp.length() > 100)
+	if (len > 100)
 	{
 		// search last space
-		int pos = tmp.lastIndexOf(' ', 100);
+		int spacePos = 100;
 
-		if (pos > -1)
-		{
-			// truncate until space
-			tmp = tmp.left(pos);
-		}
-		else
-		{
-			// truncate at 100 characters
-			tmp = tmp.left(100);
-		}
+		while (spacePos >= 0 && dst[spacePos] != ' ') --spacePos;
+
+		// truncate until space or at 100 characters
+		len = spacePos > -1 ? spacePos : 100;
 	}
 
+	tmp.resize(len);
+
 	return tmp.trimmed();
 }
 
+// more different patterns are unlikely, cache is only cleared to limit memory
+#define MAX_CACHED_REGULAR_EXPRESSIONS 64
+
+QRegularExpression getRegularExpression(const QString& pattern)
+{
+	static QMutex s_mutex;
+	static QHash<QString, QRegularExpression> s_regularExpressions;
+
+	QMutexLocker locker(&s_mutex);
+
+	QHash<QString, QRegularExpression>::const_iterator it = s_regularExpressions.constFind(pattern);
+
+	// copies share the same compiled pattern
+	if (it != s_regularExpressions.constEnd()) return it.value();
+
+	if (s_regularExpressions.size() >= MAX_CACHED_REGULAR_EXPRESSIONS) s_regularExpressions.clear();
+
+	QRegularExpression reg(pattern);
+
+	// compile it now (with JIT if supported) instead of at first match
+	reg.optimize();
+
+	s_regularExpressions.insert(pattern, reg);
+
+	return reg;
+}
+
+static bool parseNumber(const QString& str, int& pos, qint64* number)
+{
+	int start = pos;
+	qint64 value = 0;
+
+	while (pos < str.length() && str[pos] >= '0' && str[pos] <= '9')
+	{
+		// 18 digits always fit in a qint64
+		if (pos - start >= 18) return false;
+
+		value = value * 10 + (str[pos].unicode() - '0');
+
+		++pos;
+	}
+
+	if (number) *number = value;
+
+	// at least one digit
+	return pos > start;
+}
+
+bool parseContentRange(const QString& contentRange, qint64* first, qint64* last, qint64* total)
+{
+	// bytes 100-199/1000
+	if (!contentRange.startsWith(QLatin1String("bytes "))) return false;
+
+	int pos = 6;
+
+	if (!parseNumber(contentRange, pos, first)) return false;
+	if (pos >= contentRange.length() || contentRange[pos++] != '-') return false;
+
+	if (!parseNumber(contentRange, pos, last)) return false;
+	if (pos >= contentRange.length() || contentRange[pos++] != '/') return false;
+
+	if (!parseNumber(contentRange, pos, total)) return false;
+
+	return pos == contentRange.length();
+}
+
+static inline bool isFilenameCharacter(QChar c)
+{
+	// [a-zA-Z0-9._-]
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-';
+}
+
+static bool parseFilename(const QString& str, int& pos, QString* filename)
+{
+	int start = pos;
+
+	while (pos < str.length() && isFilenameCharacter(str[pos])) ++pos;
+
+	if (pos == start) return false;
+
+	if (filename) *filename = str.mid(start, pos - start);
+
+	return true;
+}
+
+bool parseContentDisposition(const QString& contentDisposition, QString* asciiFilename, QString* utf8Filename)
+{
+	// attachment; filename="file.jpg"; filename*=utf-8''file.jpg
+	static const QLatin1String s_ascii("attachment; filename=\"");
+	static const QLatin1String s_utf8("; filename*=utf-8''");
+
+	if (!contentDisposition.startsWith(s_ascii)) return false;
+
+	int pos = s_ascii.size();
+
+	if (!parseFilename(contentDisposition, pos, asciiFilename)) return false;
+	if (pos >= contentDisposition.length() || contentDisposition[pos++] != '"') return false;
+
+	if (utf8Filename) utf8Filename->clear();
+
+	// only ASCII filename
+	if (pos == contentDisposition.length()) return true;
+
+	if (contentDisposition.mid(pos, s_utf8.size()) != s_utf8) return false;
+
+	pos += s_utf8.size();
+
+	if (!parseFilename(contentDisposition, pos, utf8Filename)) return false;
+
+	return pos == contentDisposition.length();
+}
+
 QString makeFilenameFromUrl(const QString& url, const QString &mediaId)
 {
 	QString ext, basename;
@@ -403,3 +563,165 @@ bool saveFile(const QString& filename, const QByteArray& data, const QDateTime&
 
 	return false;
 }
+
+bool syncFile(QFile* file)
+{
+#ifdef Q_OS_WIN32
+	return _commit(file->handle()) == 0;
+#elif defined(Q_OS_MAC)
+	// fdatasync doesn't exist under macOS
+	return ::fsync(file->handle()) == 0;
+#else
+	// metadata (access time, etc...) are not needed
+	return ::fdatasync(file->handle()) == 0;
+#endif
+}
+
+bool syncDirectory(const QString& directory)
+{
+#ifdef Q_OS_WIN32
+	// NTFS journals metadata, directories can't be flushed like files
+	Q_UNUSED(directory);
+
+	return true;
+#else
+	int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY);
+
+	if (fd == -1) return false;
+
+	bool res = ::fsync(fd) == 0;
+
+	::close(fd);
+
+	return res;
+#endif
+}
+
+bool linkFile(const QString& source, const QString& destination)
+{
+#ifdef Q_OS_WIN32
+	// NTFS doesn't support reflinks, use a hard link
+	return CreateHardLinkW((LPCWSTR)QDir::toNativeSeparators(destination).utf16(), (LPCWSTR)QDir::toNativeSeparators(source).utf16(), NULL) != 0;
+#else
+	QByteArray src = QFile::encodeName(source);
+	QByteArray dst = QFile::encodeName(destination);
+
+#ifdef FICLONE
+	// try a reflink first, both files will be independent (Btrfs, XFS)
+	int fdSrc = ::open(src.constData(), O_RDONLY);
+
+	if (fdSrc != -1)
+	{
+		int fdDst = ::open(dst.constData(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+		if (fdDst != -1)
+		{
+			bool res = ::ioctl(fdDst, FICLONE, fdSrc) == 0;
+
+			::close(fdDst);
+			::close(fdSrc);
+
+			if (res) return true;
+
+			::unlink(dst.constData());
+		}
+		else
+		{
+			::close(fdSrc);
+		}
+	}
+#endif
+
+	// else a hard link, only works on same filesystem
+	return ::link(src.constData(), dst.constData()) == 0;
+#endif
+}
+
+bool appendChecksumToManifest(const QString& filename, const QByteArray& sha256)
+{
+	QFileInfo info(filename);
+
+	QFile file(info.absolutePath() + "/SHA256SUMS");
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) return false;
+
+	// same format as sha256sum so it can be checked with "sha256sum -c"
+	QByteArray line = sha256.toHex() + "  " + info.fileName().toUtf8() + "\n";
+
+	bool res = file.write(line) == line.size();
+
+	file.close();
+
+	return res;
+}
+
+// name of the file in a line of sha256sum, empty if not valid
+static QString manifestFilename(const QByteArray& line)
+{
+	// 64 hexadecimal digits, a space and a space or "*" for binary mode
+	if (line.size() < 67 || line[64] != ' ') return QString();
+
+	return QString::fromUtf8(line.mid(66)).trimmed();
+}
+
+bool replaceChecksumInManifest(const QString& filename, const QByteArray& sha256)
+{
+	QFileInfo info(filename);
+
+	QString manifest = info.absolutePath() + "/SHA256SUMS";
+
+	QByteArray data;
+
+	{
+		QFile file(manifest);
+
+		if (file.open(QIODevice::ReadOnly)) data = file.readAll();
+	}
+
+	// readers never see a partial manifest
+	QSaveFile file(manifest);
+
+	if (!file.open(QIODevice::WriteOnly)) return false;
+
+	for (const QByteArray& line : data.split('\n'))
+	{
+		if (line.isEmpty() || manifestFilename(line) == info.fileName()) continue;
+
+		file.write(line + "\n");
+	}
+
+	file.write(sha256.toHex() + "  " + info.fileName().toUtf8() + "\n");
+
+	return file.commit();
+}
+
+QStringList readChecksumManifest(const QString& directory)
+{
+	QStringList filenames;
+
+	QFile file(directory + "/SHA256SUMS");
+
+	if (!file.open(QIODevice::ReadOnly)) return filenames;
+
+	while (!file.atEnd())
+	{
+		QString filename = manifestFilename(file.readLine());
+
+		if (!filename.isEmpty()) filenames << filename;
+	}
+
+	return filenames;
+}
+
+QByteArray computeFileSha256(const QString& filename)
+{
+	QFile file(filename);
+
+	if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+	QCryptographicHash hash(QCryptographicHash::Sha256);
+
+	if (!hash.addData(&file)) return QByteArray();
+
+	return hash.result();
+}
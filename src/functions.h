@@ -30,8 +30,38 @@ QString getFilenameFromUrl(const QString& url);
 bool parseUrl(const QString& url, QString* basename, QString* ext);
 QString getChecksumFromUrl(const QString& url);
 QString fixFilename(const QString& url);
+
+// compiled once and shared by all callers, for patterns only known at runtime
+QRegularExpression getRegularExpression(const QString& pattern);
+
+// parse "bytes first-last/total"
+bool parseContentRange(const QString& contentRange, qint64* first, qint64* last, qint64* total);
+
+// parse 'attachment; filename="ascii"' optionally followed by "; filename*=utf-8''utf8"
+bool parseContentDisposition(const QString& contentDisposition, QString* asciiFilename, QString* utf8Filename);
 QString makeFilenameFromUrl(const QString& url, const QString& mediaId);
 
 bool saveFile(const QString& filename, const QByteArray& data, const QDateTime& date);
 
+// write file data on disk, not only in system cache
+bool syncFile(QFile* file);
+
+// write directory entries (new or renamed files) on disk
+bool syncDirectory(const QString& directory);
+
+// share data of source file with destination (reflink or hard link), don't copy it
+bool linkFile(const QString& source, const QString& destination);
+
+// append a line compatible with sha256sum to the manifest of the file directory
+bool appendChecksumToManifest(const QString& filename, const QByteArray& sha256);
+
+// same as append but previous lines of the file are removed
+bool replaceChecksumInManifest(const QString& filename, const QByteArray& sha256);
+
+// names of files listed in the manifest of a directory
+QStringList readChecksumManifest(const QString& directory);
+
+// empty if file can't be read
+QByteArray computeFileSha256(const QString& filename);
+
 #endif
@@ -0,0 +1,202 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "harrecorder.h"
+#include "filewriter.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+static QJsonArray headersToJson(const QList<QNetworkReply::RawHeaderPair>& headers)
+{
+	QJsonArray array;
+
+	for (const QNetworkReply::RawHeaderPair& header : headers)
+	{
+		QJsonObject object;
+		object["name"] = QString::fromLatin1(header.first);
+		object["value"] = QString::fromLatin1(header.second);
+
+		array << object;
+	}
+
+	return array;
+}
+
+static QJsonArray requestHeadersToJson(const QNetworkRequest& request)
+{
+	QList<QNetworkReply::RawHeaderPair> headers;
+
+	for (const QByteArray& name : request.rawHeaderList())
+	{
+		headers << qMakePair(name, request.rawHeader(name));
+	}
+
+	return headersToJson(headers);
+}
+
+static QJsonArray cookiesToJson(const QList<QNetworkCookie>& cookies)
+{
+	QJsonArray array;
+
+	for (const QNetworkCookie& cookie : cookies)
+	{
+		QJsonObject object;
+		object["name"] = QString::fromUtf8(cookie.name());
+		object["value"] = QString::fromUtf8(cookie.value());
+
+		if (!cookie.path().isEmpty()) object["path"] = cookie.path();
+		if (!cookie.domain().isEmpty()) object["domain"] = cookie.domain();
+		if (cookie.expirationDate().isValid()) object["expires"] = cookie.expirationDate().toString(Qt::ISODateWithMs);
+
+		object["httpOnly"] = cookie.isHttpOnly();
+		object["secure"] = cookie.isSecure();
+
+		array << object;
+	}
+
+	return array;
+}
+
+static QString operationName(QNetworkAccessManager::Operation operation)
+{
+	switch (operation)
+	{
+		case QNetworkAccessManager::HeadOperation: return "HEAD";
+		case QNetworkAccessManager::GetOperation: return "GET";
+		case QNetworkAccessManager::PutOperation: return "PUT";
+		case QNetworkAccessManager::PostOperation: return "POST";
+		case QNetworkAccessManager::DeleteOperation: return "DELETE";
+		default: break;
+	}
+
+	return "UNKNOWN";
+}
+
+HarRecorder::HarRecorder(FileWriter* writer):m_writer(writer), m_count(0)
+{
+}
+
+HarRecorder::~HarRecorder()
+{
+	if (!m_file) return;
+
+	m_writer->write(m_file, "\n]}}\n");
+	m_writer->close(m_file);
+	m_writer->waitForFile(m_file);
+
+	if (m_writer->takeError(m_file)) qWarning() << "Unable to write" << m_file->fileName();
+}
+
+bool HarRecorder::open(const QString& filename)
+{
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	m_file.reset(new QFile(filename));
+
+	// FileWriter needs unbuffered files
+	if (!m_file->open(QFile::WriteOnly | QFile::Truncate | QFile::Unbuffered))
+	{
+		m_file.reset();
+
+		return false;
+	}
+
+	QJsonObject creator;
+	creator["name"] = QCoreApplication::applicationName();
+	creator["version"] = QCoreApplication::applicationVersion();
+
+	// entries are appended to the array
+	m_writer->write(m_file, "{\"log\":{\"version\":\"1.2\",\"creator\":" + QJsonDocument(creator).toJson(QJsonDocument::Compact) + ",\"entries\":[\n");
+
+	return true;
+}
+
+void HarRecorder::record(QNetworkReply* reply, const QList<QNetworkCookie>& requestCookies, qint64 duration)
+{
+	if (!m_file) return;
+
+	QNetworkRequest networkRequest = reply->request();
+	QUrl url = reply->url();
+
+	QString httpVersion = reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool() ? "HTTP/2.0" : "HTTP/1.1";
+
+	QJsonArray queryString;
+
+	for (const QPair<QString, QString>& item : QUrlQuery(url).queryItems(QUrl::FullyDecoded))
+	{
+		QJsonObject object;
+		object["name"] = item.first;
+		object["value"] = item.second;
+
+		queryString << object;
+	}
+
+	QJsonObject request;
+	request["method"] = operationName(reply->operation());
+	request["url"] = url.toString();
+	request["httpVersion"] = httpVersion;
+	request["cookies"] = cookiesToJson(requestCookies);
+	request["headers"] = requestHeadersToJson(networkRequest);
+	request["queryString"] = queryString;
+	request["headersSize"] = -1;
+	request["bodySize"] = -1;
+
+	QVariant contentLength = reply->header(QNetworkRequest::ContentLengthHeader);
+
+	QJsonObject content;
+	content["size"] = contentLength.isValid() ? contentLength.toLongLong() : 0;
+	content["mimeType"] = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+
+	QJsonObject response;
+	response["status"] = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	response["statusText"] = reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString();
+	response["httpVersion"] = httpVersion;
+	response["cookies"] = cookiesToJson(reply->header(QNetworkRequest::SetCookieHeader).value<QList<QNetworkCookie> >());
+	response["headers"] = headersToJson(reply->rawHeaderPairs());
+	response["content"] = content;
+	response["redirectURL"] = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl().toString();
+	response["headersSize"] = -1;
+	response["bodySize"] = contentLength.isValid() ? contentLength.toLongLong() : -1;
+
+	if (reply->error() != QNetworkReply::NoError) response["_error"] = reply->errorString();
+
+	// only total time is known
+	QJsonObject timings;
+	timings["send"] = 0;
+	timings["wait"] = qMax(duration, (qint64)0);
+	timings["receive"] = 0;
+
+	QJsonObject entry;
+	entry["startedDateTime"] = QDateTime::currentDateTime().addMSecs(-qMax(duration, (qint64)0)).toString(Qt::ISODateWithMs);
+	entry["time"] = qMax(duration, (qint64)0);
+	entry["request"] = request;
+	entry["response"] = response;
+	entry["cache"] = QJsonObject();
+	entry["timings"] = timings;
+
+	QByteArray data = QJsonDocument(entry).toJson(QJsonDocument::Compact);
+
+	if (m_count++ > 0) data.prepend(",\n");
+
+	// written in another thread
+	m_writer->write(m_file, data);
+}
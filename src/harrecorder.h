@@ -0,0 +1,45 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HARRECORDER_H
+#define HARRECORDER_H
+
+class FileWriter;
+
+// write requests and responses in an HTTP Archive (HAR 1.2) file, entries
+// are written by FileWriter thread as soon as they are recorded and JSON is
+// only complete once recorder is deleted
+class HarRecorder
+{
+public:
+	HarRecorder(FileWriter* writer);
+	~HarRecorder();
+
+	bool open(const QString& filename);
+
+	// duration is in ms since request was sent, HAR requires it to be positive
+	void record(QNetworkReply* reply, const QList<QNetworkCookie>& requestCookies, qint64 duration);
+
+private:
+	FileWriter *m_writer;
+	QSharedPointer<QFile> m_file;
+	int m_count;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "hostprefetcher.h"
+#include "metrics.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// QHostInfo doesn't return TTL of records, use the same lifetime as the internal Qt cache
+#define HOST_TTL 60000
+
+// limit memory used by long sessions
+#define MAX_HOSTS 1000
+
+HostPrefetcher::HostPrefetcher(QNetworkAccessManager* manager, QObject* parent):QObject(parent), m_manager(manager), m_hits(0), m_misses(0)
+{
+}
+
+HostPrefetcher::~HostPrefetcher()
+{
+	clear();
+}
+
+void HostPrefetcher::clear()
+{
+	// results of pending lookups will be ignored
+	for (QHash<int, QString>::const_iterator it = m_lookups.constBegin(); it != m_lookups.constEnd(); ++it)
+	{
+		QHostInfo::abortHostLookup(it.key());
+	}
+
+	m_lookups.clear();
+	m_pending.clear();
+	m_expirations.clear();
+	m_lastConnected.clear();
+}
+
+bool HostPrefetcher::isResolved(const QString& host) const
+{
+	QHash<QString, qint64>::const_iterator it = m_expirations.constFind(host);
+
+	return it != m_expirations.constEnd() && it.value() > QDateTime::currentMSecsSinceEpoch();
+}
+
+void HostPrefetcher::resolve(const QUrl& url)
+{
+	QString host = url.host();
+
+	if (host.isEmpty() || m_pending.contains(host) || isResolved(host)) return;
+
+	// IP addresses don't need to be resolved
+	if (!QHostAddress(host).isNull()) return;
+
+	if (m_expirations.size() >= MAX_HOSTS) m_expirations.clear();
+
+	m_pending.insert(host);
+
+	// also fill Qt cache used by QNetworkAccessManager
+	int id = QHostInfo::lookupHost(host, this, &HostPrefetcher::onLookedUp);
+
+	m_lookups[id] = host;
+}
+
+void HostPrefetcher::preconnect(const QUrl& url)
+{
+	QString host = url.host();
+
+	if (host.isEmpty()) return;
+
+	bool encrypted = url.scheme() == "https";
+	int port = url.port(encrypted ? 443 : 80);
+
+	QString key = QString("%1:%2").arg(host).arg(port);
+
+	// connections are kept alive by QNetworkAccessManager
+	if (key == m_lastConnected) return;
+
+	m_lastConnected = key;
+
+	if (encrypted)
+	{
+#if QT_CONFIG(ssl)
+		m_manager->connectToHostEncrypted(host, port);
+#endif
+	}
+	else
+	{
+		m_manager->connectToHost(host, port);
+	}
+}
+
+void HostPrefetcher::processRequest(const QUrl& url)
+{
+	QString host = url.host();
+
+	if (host.isEmpty() || !QHostAddress(host).isNull()) return;
+
+	if (isResolved(host))
+	{
+		++m_hits;
+
+		Metrics::increment("dns_cache_hits_total");
+	}
+	else
+	{
+		++m_misses;
+
+		Metrics::increment("dns_cache_misses_total");
+	}
+
+	Metrics::setGauge("dns_cache_hit_rate_percent", m_hits * 100 / (m_hits + m_misses));
+}
+
+void HostPrefetcher::onLookedUp(const QHostInfo& info)
+{
+	QString host = m_lookups.take(info.lookupId());
+
+	if (host.isEmpty()) return;
+
+	m_pending.remove(host);
+
+	// request will report the error
+	if (info.error() != QHostInfo::NoError || info.addresses().isEmpty()) return;
+
+	m_expirations[host] = QDateTime::currentMSecsSinceEpoch() + HOST_TTL;
+}
@@ -0,0 +1,64 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOSTPREFETCHER_H
+#define HOSTPREFETCHER_H
+
+class QNetworkAccessManager;
+
+// resolve hosts of next entries before they are requested and open a
+// connection to the next one, results are kept in a cache with the same
+// lifetime as the Qt one so requests find them already resolved
+class HostPrefetcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	HostPrefetcher(QNetworkAccessManager* manager, QObject* parent);
+	virtual ~HostPrefetcher();
+
+	// only resolve host
+	void resolve(const QUrl& url);
+
+	// resolve host and open a connection (with TLS handshake if needed)
+	void preconnect(const QUrl& url);
+
+	// count a hit if host was already resolved when url is requested
+	void processRequest(const QUrl& url);
+
+	void clear();
+
+private slots:
+	void onLookedUp(const QHostInfo& info);
+
+private:
+	bool isResolved(const QString& host) const;
+
+	QNetworkAccessManager *m_manager;
+
+	QHash<QString, qint64> m_expirations; // resolved hosts, in ms since epoch
+	QHash<int, QString> m_lookups; // pending lookups by ID
+	QSet<QString> m_pending;
+	QString m_lastConnected; // host:port
+
+	qint64 m_hits;
+	qint64 m_misses;
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "logsink.h"
+#include "filewriter.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// lines are added to view at most 10 times per second
+#define FLUSH_INTERVAL 100
+
+// lines waiting to be displayed, oldest ones are dropped
+#define MAX_PENDING_LINES 1000
+
+// lines kept in view
+#define MAX_DISPLAYED_LINES 10000
+
+// files are rotated when bigger
+#define MAX_FILE_SIZE (10 * 1024 * 1024)
+
+// number of old files kept (.1, .2, etc...)
+#define MAX_OLD_FILES 3
+
+static const char* s_levels[] = { "info", "success", "warning", "error" };
+
+LogSink::LogSink(QTextEdit* view, QObject* parent):QObject(parent), m_view(view), m_level(Level::Info), m_first(0), m_count(0), m_dropped(0),
+	m_fileSize(0), m_writer(nullptr)
+{
+	m_lines.resize(MAX_PENDING_LINES);
+
+	// oldest blocks are removed automatically
+	m_view->document()->setMaximumBlockCount(MAX_DISPLAYED_LINES);
+
+	m_timer = new QTimer(this);
+	m_timer->setSingleShot(true);
+	m_timer->setInterval(FLUSH_INTERVAL);
+	connect(m_timer, &QTimer::timeout, this, &LogSink::onFlush);
+}
+
+LogSink::~LogSink()
+{
+	setFile(QString());
+}
+
+void LogSink::setLevel(Level level)
+{
+	m_level = level;
+}
+
+LogSink::Level LogSink::levelFromString(const QString& level)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		if (level == s_levels[i]) return (Level)i;
+	}
+
+	return Level::Info;
+}
+
+bool LogSink::setFile(const QString& filename)
+{
+	if (filename == m_filename && (m_file || filename.isEmpty())) return true;
+
+	if (m_file)
+	{
+		writeFile();
+
+		m_writer->close(m_file);
+		m_writer->waitForFile(m_file);
+
+		m_file.reset();
+	}
+
+	m_filename = filename;
+
+	if (m_filename.isEmpty())
+	{
+		delete m_writer;
+		m_writer = nullptr;
+
+		return true;
+	}
+
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+
+	m_file.reset(new QFile(m_filename));
+
+	if (!m_file->open(QFile::Append | QFile::Unbuffered))
+	{
+		qWarning() << "Unable to open log file" << m_filename;
+
+		m_file.reset();
+
+		return false;
+	}
+
+	m_fileSize = m_file->size();
+
+	if (!m_writer) m_writer = new FileWriter(this);
+
+	return true;
+}
+
+void LogSink::append(Level level, const QString& message)
+{
+	// all lines are written in file
+	if (m_file)
+	{
+		m_fileData += QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8() + " [" + s_levels[(int)level] + "] " + message.toUtf8() + "\n";
+	}
+
+	if (level >= m_level)
+	{
+		// too many lines since last refresh, drop oldest one
+		if (m_count == m_lines.size())
+		{
+			m_first = (m_first + 1) % m_lines.size();
+
+			--m_count;
+			++m_dropped;
+		}
+
+		Line& line = m_lines[(m_first + m_count) % m_lines.size()];
+		line.level = level;
+		line.message = message;
+
+		++m_count;
+	}
+
+	if (!m_timer->isActive()) m_timer->start();
+}
+
+void LogSink::onFlush()
+{
+	if (m_count > 0 || m_dropped > 0)
+	{
+		QString html;
+
+		if (m_dropped > 0)
+		{
+			html += "<div class='warning'>" + tr("%n line(s) not displayed", "", m_dropped) + "</div>";
+
+			m_dropped = 0;
+		}
+
+		for (int i = 0; i < m_count; ++i)
+		{
+			Line& line = m_lines[(m_first + i) % m_lines.size()];
+
+			html += QString("<div class='") + s_levels[(int)line.level] + "'>" + line.message + "</div>";
+
+			// release string
+			line.message.clear();
+		}
+
+		m_first = 0;
+		m_count = 0;
+
+		// only one layout and scroll for all lines
+		m_view->append(html);
+		m_view->moveCursor(QTextCursor::End);
+		m_view->ensureCursorVisible();
+	}
+
+	writeFile();
+}
+
+void LogSink::writeFile()
+{
+	if (!m_file || m_fileData.isEmpty()) return;
+
+	if (m_fileSize > 0 && m_fileSize + m_fileData.size() > MAX_FILE_SIZE) rotateFile();
+
+	if (!m_file) return;
+
+	// written in another thread
+	m_writer->write(m_file, m_fileData);
+
+	m_fileSize += m_fileData.size();
+	m_fileData.clear();
+}
+
+void LogSink::rotateFile()
+{
+	m_writer->close(m_file);
+	m_writer->waitForFile(m_file);
+
+	m_file.reset();
+
+	// file.log.2 -> file.log.3, file.log.1 -> file.log.2, file.log -> file.log.1
+	QFile::remove(QString("%1.%2").arg(m_filename).arg(MAX_OLD_FILES));
+
+	for (int i = MAX_OLD_FILES - 1; i > 0; --i)
+	{
+		QFile::rename(QString("%1.%2").arg(m_filename).arg(i), QString("%1.%2").arg(m_filename).arg(i + 1));
+	}
+
+	QFile::rename(m_filename, m_filename + ".1");
+
+	m_file.reset(new QFile(m_filename));
+
+	if (!m_file->open(QFile::Append | QFile::Unbuffered))
+	{
+		qWarning() << "Unable to open log file" << m_filename;
+
+		m_file.reset();
+	}
+
+	m_fileSize = 0;
+}
@@ -0,0 +1,85 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+class FileWriter;
+
+// display logs in a text edit and write them in a file, lines are buffered
+// and added together a few times per second, the number of lines kept in
+// memory is limited and files are rotated when they are too big
+class LogSink : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum class Level
+	{
+		Info,
+		Success,
+		Warning,
+		Error
+	};
+
+	LogSink(QTextEdit* view, QObject* parent);
+	virtual ~LogSink();
+
+	// lines with a lower level are only written in file
+	void setLevel(Level level);
+
+	// empty to disable
+	bool setFile(const QString& filename);
+
+	void append(Level level, const QString& message);
+
+	static Level levelFromString(const QString& level);
+
+private slots:
+	void onFlush();
+
+private:
+	struct Line
+	{
+		Level level;
+		QString message;
+	};
+
+	void writeFile();
+	void rotateFile();
+
+	QTextEdit *m_view;
+	Level m_level;
+
+	// ring buffer of lines not displayed yet
+	QVector<Line> m_lines;
+	int m_first;
+	int m_count;
+	int m_dropped;
+
+	QTimer *m_timer;
+
+	QString m_filename;
+	QSharedPointer<QFile> m_file;
+	qint64 m_fileSize;
+	QByteArray m_fileData; // lines not written yet
+	FileWriter *m_writer;
+};
+
+#endif
@@ -19,6 +19,8 @@
 
 #include "common.h"
 #include "mainwindow.h"
+#include "benchmark.h"
+#include "utils.h"
 
 #ifdef HAVE_CONFIG_H
 	#include "config.h"
@@ -57,6 +59,23 @@ int main(int argc, char *argv[])
 	QCoreApplication::setOrganizationName(AUTHOR);
 	QCoreApplication::setApplicationVersion(VERSION);
 
+	// hidden options to measure per URL helpers and downloads without opening window
+	QCommandLineParser parser;
+	parser.addOption(QCommandLineOption("benchmark"));
+	parser.addOption(QCommandLineOption("corpus", "", "file"));
+	parser.addOption(QCommandLineOption("baseline", "", "file"));
+	parser.addOption(QCommandLineOption("benchmark-downloads", "", "scenario"));
+	parser.parse(app.arguments());
+
+	// results would be lost under Windows
+	if ((parser.isSet("benchmark") || parser.isSet("benchmark-downloads")) && !attachConsole())
+	{
+		return 1;
+	}
+
+	if (parser.isSet("benchmark")) return benchmarkHelpers(parser.value("corpus"), parser.value("baseline"));
+	if (parser.isSet("benchmark-downloads")) return benchmarkDownloads(parser.value("benchmark-downloads"));
+
 	QString folder;
 	QDir dir(QCoreApplication::applicationDirPath());
 	
@@ -29,6 +29,11 @@
 #include "systrayicon.h"
 #include "updater.h"
 #include "updatedialog.h"
+#include "csvreader.h"
+#include "batchesmodel.h"
+#include "logsink.h"
+#include "metrics.h"
+#include "tracer.h"
 
 #include <QtWidgets/QFileDialog>
 
@@ -38,7 +43,10 @@
 #define USE_TASKBAR
 #endif
 
-MainWindow::MainWindow():QMainWindow(), m_button(nullptr)
+// entries of a batch queued at once, next ones are queued while they are downloaded
+#define QUEUED_ENTRIES_PER_BATCH 32
+
+MainWindow::MainWindow():QMainWindow(), m_button(nullptr), m_batchesModel(nullptr), m_nextBatch(0), m_downloading(false), m_csvReader(nullptr), m_csvGeneration(0), m_csvReading(false), m_log(nullptr), m_metrics(nullptr)
 {
 	m_ui = new Ui::MainWindow();
 	m_ui->setupUi(this);
@@ -51,11 +59,15 @@ MainWindow::MainWindow():QMainWindow(), m_button(nullptr)
 #endif
 
 	m_manager = new DownloadManager(this);
+	m_manager->setMirrorStatsFile(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/mirrors.txt");
 
 	connect(m_manager, &DownloadManager::queueStarted, this, &MainWindow::onQueueStarted);
 	connect(m_manager, &DownloadManager::queueProgress, this, &MainWindow::onQueueProgress);
 	connect(m_manager, &DownloadManager::queueFinished, this, &MainWindow::onQueueFinished);
 
+	connect(m_manager, &DownloadManager::batchProgress, this, &MainWindow::onBatchProgress);
+	connect(m_manager, &DownloadManager::batchFinished, this, &MainWindow::onBatchFinished);
+
 	connect(m_manager, &DownloadManager::downloadStarted, this, &MainWindow::onDownloadStarted);
 	connect(m_manager, &DownloadManager::downloadProgress, this, &MainWindow::onDownloadProgress);
 	connect(m_manager, &DownloadManager::downloadSucceeded, this, &MainWindow::onDownloadSucceeded);
@@ -64,6 +76,7 @@ MainWindow::MainWindow():QMainWindow(), m_button(nullptr)
 	connect(m_manager, &DownloadManager::downloadInfo, this, &MainWindow::onDownloadInfo);
 	connect(m_manager, &DownloadManager::downloadWarning, this, &MainWindow::onDownloadWarning);
 	connect(m_manager, &DownloadManager::downloadError, this, &MainWindow::onDownloadError);
+	connect(m_manager, &DownloadManager::downloadFailed, this, &MainWindow::onDownloadFailed);
 
 	// void downloadRedirected(const QString & url, const QDateTime & lastModified, const DownloadEntry & entry);
 	m_fileLabel = new QLabel(this);
@@ -105,7 +118,21 @@ MainWindow::MainWindow():QMainWindow(), m_button(nullptr)
 	doc->setDefaultStyleSheet(".error { color: #f00; }\n.warning { color: #f80; }\n.info { }\n.success { #0f0; }\n");
 	m_ui->logsTextEdit->setDocument(doc);
 
-	m_ui->urlsListView->setModel(new QStringListModel(this));
+	m_log = new LogSink(m_ui->logsTextEdit, this);
+	m_log->setLevel(LogSink::levelFromString(m_settings.value("LogLevel", "info").toString()));
+
+	// files are disabled by default
+	m_log->setFile(m_settings.value("LogFile").toString());
+
+	m_metrics = new MetricsExporter(this);
+	m_metrics->listen(m_settings.value("MetricsPort", 0).toUInt());
+	m_metrics->setFile(m_settings.value("MetricsFile").toString());
+
+	m_batchesModel = new BatchesModel(this);
+
+	m_ui->urlsView->setModel(m_batchesModel);
+	m_ui->urlsView->verticalHeader()->hide();
+	m_ui->urlsView->horizontalHeader()->setSectionResizeMode(BatchesModel::ColumnUrl, QHeaderView::Stretch);
 
 	SystrayIcon* systray = new SystrayIcon(this);
 
@@ -118,6 +145,7 @@ MainWindow::MainWindow():QMainWindow(), m_button(nullptr)
 
 MainWindow::~MainWindow()
 {
+	delete m_csvReader;
 	delete m_ui;
 }
 
@@ -198,9 +226,10 @@ void MainWindow::onExportCSV()
 
 void MainWindow::onClear()
 {
-	m_ui->urlsListView->model()->removeRows(0, m_batches.size());
+	stopCSV();
 
-	m_batches.clear();
+	m_batchesModel->clear();
+	m_nextBatch = 0;
 
 	m_manager->reset();
 }
@@ -287,154 +316,79 @@ void MainWindow::onProgress(qint64 readBytes, qint64 totalBytes)
 
 bool MainWindow::loadCSV(const QString& filename)
 {
-	QFile file(filename);
+	if (!QFileInfo(filename).isReadable()) return false;
 
-	if (!file.open(QFile::ReadOnly)) return false;
+	stopCSV();
 
-	// parse first line with headers
-	QByteArray line = file.readLine().trimmed();
+	m_batchesModel->clear();
+	m_nextBatch = 0;
 
-	QByteArrayList headers = line.split(',');
+	// parsed in another thread and batches are added while parsing
+	m_csvReader = new CsvReader(filename, this);
 
-	int urlIndex = -1;
-	int refererIndex = -1;
-	int directoryIndex = -1;
-	int firstIndex = -1;
-	int lastIndex = -1;
-	int stepIndex = -1;
+	int generation = m_csvGeneration;
 
-	for (int i = 0, ilen = headers.size(); i < ilen; ++i)
+	// signals already posted by a stopped import are still delivered
+	connect(m_csvReader, &CsvReader::batchesRead, this, [this, generation](const Batches& batches)
 	{
-		auto header = headers[i];
+		if (generation == m_csvGeneration) onBatchesRead(batches);
+	});
 
-		if (header == "url")
-		{
-			urlIndex = i;
-		}
-		else if (header == "referer")
-		{
-			refererIndex = i;
-		}
-		else if (header == "directory")
-		{
-			directoryIndex = i;
-		}
-		else if (header == "first")
-		{
-			firstIndex = i;
-		}
-		else if (header == "last")
-		{
-			lastIndex = i;
-		}
-		else if (header == "step")
-		{
-			stepIndex = i;
-		}
-		else
-		{
-			qDebug() << "Unknown field" << header;
-
-			return false;
-		}
-	}
-
-	if (urlIndex == -1)
+	connect(m_csvReader, &CsvReader::error, this, [this, generation](const QString& error)
 	{
-		qDebug() << "URL index is required";
-
-		return false;
-	}
-
-	m_batches.clear();
-
-	QStringList urls;
+		if (generation == m_csvGeneration) onCsvError(error);
+	});
 
-	int rows = 0;
-
-	while (!file.atEnd())
+	// posted after all batches
+	connect(m_csvReader, &QThread::finished, this, [this, generation]()
 	{
-		++rows;
-
-		// parse line with data
-		line = file.readLine().trimmed();
-
-		QByteArrayList row;
-
-		bool quoteOpen = false;
-		QByteArray value;
-		
-		for (int i = 0, ilen = line.length(); i < ilen; ++i)
-		{
-			char c = line[i];
+		if (generation == m_csvGeneration) onCsvFinished();
+	});
 
-			if (c == '"')
-			{
-				if (!quoteOpen)
-				{
-					quoteOpen = true;
-				}
-				else
-				{
-					quoteOpen = false;
-				}
-			}
-			else if (c == ',' && !quoteOpen)
-			{
-				row << value;
+	m_csvReading = true;
 
-				value.clear();
-			}
-			else
-			{
-				value += c;
-			}
-		}
-
-		if (!value.isEmpty())
-		{
-			row << value;
-		}
+	m_csvReader->start();
 
-		if (row.size() != headers.size())
-		{
-			qDebug() << "Wrong fields number";
-
-			return false;
-		}
+	return true;
+}
 
-		Batch batch;
+void MainWindow::stopCSV()
+{
+	// ignore batches of previous import
+	++m_csvGeneration;
 
-		batch.url = row[urlIndex];
+	m_csvReading = false;
 
-		urls << batch.url;
+	delete m_csvReader;
+	m_csvReader = nullptr;
+}
 
-		if (refererIndex > -1)
-		{
-			batch.referer = row[refererIndex];
-		}
+void MainWindow::onBatchesRead(const Batches& batches)
+{
+	m_batchesModel->append(batches);
 
-		if (directoryIndex > -1)
-		{
-			batch.directory = row[directoryIndex];
+	// already downloading, manager could have finished previous entries
+	if (m_downloading)
+	{
+		queueNextBatches();
 
-			// remove quotes
-			if (batch.directory.length() > 2 && batch.directory[0] == '"' && batch.directory[batch.directory.length() - 1] == '"')
-			{
-				batch.directory = batch.directory.mid(1, batch.directory.length() - 2);
-			}
-		}
+		m_manager->start();
+	}
+}
 
-		batch.first = firstIndex > -1 ? row[firstIndex].toInt() : 1;
-		batch.last = lastIndex > -1 ? row[lastIndex].toInt() : 1;
-		batch.step = stepIndex > -1 ? row[stepIndex].toInt() : 1;
+void MainWindow::onCsvError(const QString& error)
+{
+	printError(error);
 
-		m_batches << batch;
-	}
+	QMessageBox::critical(this, tr("Error"), tr("Unable to load or parse CSV file."));
+}
 
-	qobject_cast<QStringListModel*>(m_ui->urlsListView->model())->setStringList(urls);
+void MainWindow::onCsvFinished()
+{
+	m_csvReading = false;
 
-	return true;
+	// all batches have been downloaded before the end of the file
+	if (m_downloading && m_manager->isEmpty()) onQueueFinished(false);
 }
 
 bool MainWindow::saveCSV(const QString& filename) const
@@ -446,9 +400,9 @@ bool MainWindow::saveCSV(const QString& filename) const
 	return true;
 }
 
-QString MainWindow::directoryFromUrl(const QString &url)
+QString MainWindow::directoryFromUrl(const QString &directory, const QString &url)
 {
-	QString dir = m_ui->folderEdit->text();
+	QString dir = directory;
 	QString lastDir = m_ui->subfolderEdit->text();
 
 	if (!lastDir.isEmpty())
@@ -502,9 +456,8 @@ QString MainWindow::fileNameFromUrl(const QString &url, int currentFile)
 
 	if (!param.isEmpty())
 	{
-		QRegularExpression paramReg(param + "=([^&]+)");
-
-		QRegularExpressionMatch match = paramReg.match(url);
+		// called for each file, don't compile it each time
+		QRegularExpressionMatch match = getRegularExpression(param + "=([^&]+)").match(url);
 
 		if (match.hasMatch())
 			fileName = match.captured(1);
@@ -702,70 +655,144 @@ void MainWindow::onBrowse()
 
 void MainWindow::onDownloadClicked()
 {
-	if (!m_manager->isEmpty())
+	if (m_downloading)
 	{
-		m_manager->stop();
+		if (m_manager->isEmpty())
+		{
+			// only waiting for imported batches
+			onQueueFinished(true);
+		}
+		else
+		{
+			m_manager->stop();
+		}
 
 		return;
 	}
 
 	saveSettings();
 
-	// save settings for later
-	if (!m_batches.isEmpty())
-	{
-		saveCurrent();
-	}
-
 	// update manager settings before to call it
 	m_manager->setStopOnError(m_settings.value("StopOnError").toBool());
 	m_manager->setUserAgent(m_settings.value("UserAgent").toString());
+	m_manager->setChecksumManifest(m_settings.value("ChecksumManifest").toBool());
+	m_manager->setVerifyChecksums(m_settings.value("VerifyChecksums").toBool());
+	m_manager->setDeduplicate(m_settings.value("Deduplicate").toBool());
+	m_manager->setPrefetchPages(m_settings.value("PrefetchPages").toInt());
+	m_manager->setPrefetchHosts(m_settings.value("PrefetchHosts", true).toBool());
 
-	downloadNextBatch();
+	// redirections are only kept during this run if empty
+	m_manager->setRedirectCacheFile(m_settings.value("RedirectCacheFile").toString());
+
+	if (!m_manager->setHarFile(m_settings.value("HarFile").toString()))
+	{
+		printWarning(tr("Unable to create HTTP Archive %1").arg(m_settings.value("HarFile").toString()));
+	}
+
+	// none, file or directory
+	QString durability = m_settings.value("Durability").toString();
+
+	if (durability == "directory")
+	{
+		m_manager->setDurability(DownloadManager::Durability::Directory);
+	}
+	else if (durability == "file")
+	{
+		m_manager->setDurability(DownloadManager::Durability::File);
+	}
+	else
+	{
+		m_manager->setDurability(DownloadManager::Durability::None);
+	}
+
+	downloadBatches();
 }
 
-void MainWindow::saveCurrent()
+void MainWindow::downloadBatches()
 {
-	m_current.directory = m_ui->folderEdit->text();
-	m_current.url = m_ui->urlEdit->text();
-	m_current.referer = m_ui->refererEdit->text();
-	m_current.first = m_ui->firstSpinBox->value();
-	m_current.last = m_ui->lastSpinBox->value();
-	m_current.step = m_ui->stepSpinBox->value();
+	if (m_batchesModel->isEmpty())
+	{
+		// fix incorrect values
+		if (m_ui->firstSpinBox->value() < 0) m_ui->firstSpinBox->setValue(0);
+		if (m_ui->lastSpinBox->value() < 0) m_ui->lastSpinBox->setValue(0);
+		if (m_ui->stepSpinBox->value() < 1) m_ui->stepSpinBox->setValue(1);
+
+		// only use fields of the window, they are read only once
+		Batch batch;
+		batch.directory = m_ui->folderEdit->text();
+		batch.url = m_ui->urlEdit->text();
+		batch.referer = m_ui->refererEdit->text();
+		batch.step = m_ui->stepSpinBox->value();
+		batch.id = m_manager->createBatch(0, 1);
+
+		queueEntries(batch, m_ui->firstSpinBox->value(), m_ui->lastSpinBox->value());
+	}
+	else
+	{
+		for (int i = 0, ilen = m_batchesModel->size(); i < ilen; ++i)
+		{
+			m_batchesModel->setId(i, -1);
+		}
+
+		m_nextBatch = 0;
+
+		// batches imported later are registered when read
+		queueNextBatches();
+	}
+
+	// initialize progress range
+	m_progressTotal->setVisible(m_manager->count() > 1 || m_nextBatch < m_batchesModel->size());
+	m_progressTotal->setMinimum(0);
+
+	m_downloading = true;
+
+	m_manager->start();
 }
 
-void MainWindow::restoreCurrent()
+void MainWindow::queueNextBatches()
 {
-	// restore current batch
-	const Batch& batch = m_current;
+	// register all batches so manager shares downloads between them according
+	// to their priorities, only their first entries are queued
+	while (m_nextBatch < m_batchesModel->size())
+	{
+		int row = m_nextBatch++;
 
-	// don't reset if URL is empty
-	if (batch.url.isEmpty()) return;
+		Batch batch = m_batchesModel->batch(row);
 
-	m_ui->folderEdit->setText(batch.directory);
-	m_ui->urlEdit->setText(batch.url);
-	m_ui->refererEdit->setText(batch.referer);
-	m_ui->firstSpinBox->setValue(batch.first);
-	m_ui->lastSpinBox->setValue(batch.last);
-	m_ui->stepSpinBox->setValue(batch.step);
+		m_batchesModel->setId(row, m_manager->createBatch(batch.priority, batch.weight));
+		m_batchesModel->setNext(row, qMax(batch.first, 0));
+
+		queueBatchEntries(row);
+	}
 }
 
-void MainWindow::downloadNextBatch()
+void MainWindow::queueBatchEntries(int row)
 {
-	if (!m_batches.isEmpty())
+	Batch batch = m_batchesModel->batch(row);
+
+	if (batch.id < 0 || batch.next < 0 || batch.next > batch.last) return;
+
+	int step = qMax(batch.step, 1);
+	int queued = 0;
+
+	// all existing files of a range could be skipped
+	while (queued == 0 && batch.next <= batch.last)
 	{
-		const Batch &batch = m_batches[0];
+		int last = qMin(batch.last, batch.next + (QUEUED_ENTRIES_PER_BATCH - 1) * step);
 
-		m_ui->folderEdit->setText(batch.directory);
-		m_ui->urlEdit->setText(batch.url);
-		m_ui->refererEdit->setText(batch.referer);
-		m_ui->firstSpinBox->setValue(batch.first);
-		m_ui->lastSpinBox->setValue(batch.last);
-		m_ui->stepSpinBox->setValue(batch.step);
+		queued = queueEntries(batch, batch.next, last);
+
+		batch.next = last + step;
 	}
 
-	m_urlFormat = m_ui->urlEdit->text();
-	m_refererFormat = m_ui->refererEdit->text();
+	m_batchesModel->setNext(row, batch.next);
+}
+
+int MainWindow::queueEntries(const Batch& batch, int first, int last)
+{
+	// fields of the window can be edited while downloading, never use them
+	m_urlFormat = batch.url;
+	m_refererFormat = batch.referer;
 	m_maskCount = 0;
 
 	QRegularExpression maskReg("(#+)");
@@ -780,28 +807,31 @@ void MainWindow::downloadNextBatch()
 		m_urlFormat.replace(mask, "%1");
 	}
 
-	// fix incorrect values
-	if (m_ui->firstSpinBox->value() < 0) m_ui->firstSpinBox->setValue(0);
-	if (m_ui->lastSpinBox->value() < 0) m_ui->lastSpinBox->setValue(0);
-	if (m_ui->stepSpinBox->value() < 1) m_ui->stepSpinBox->setValue(1);
+	// masks of mirrors can have different lengths
+	QVector<QPair<QString, int> > mirrorFormats;
 
-	// initialize progress range
-	if (m_maskCount == 0)
-	{
-		m_progressTotal->hide();
-	}
-	else
+	for (const QString& mirror : batch.mirrors)
 	{
-		m_progressTotal->show();
-		m_progressTotal->setMinimum(m_ui->firstSpinBox->value());
-		m_progressTotal->setMaximum(m_ui->lastSpinBox->value());
+		QString format = mirror;
+		int count = 0;
+
+		match = maskReg.match(format);
+
+		if (match.hasMatch())
+		{
+			count = match.capturedLength(1);
+			format.replace(match.captured(1), "%1");
+		}
+
+		mirrorFormats << qMakePair(format, count);
 	}
 
 	QString url = m_urlFormat;
 
-	int first = m_ui->firstSpinBox->value();
-	int last = m_ui->lastSpinBox->value();
-	int step = m_ui->stepSpinBox->value();
+	first = qMax(first, 0);
+
+	int step = qMax(batch.step, 1);
+	int queued = 0;
 
 	for (int i = first; i <= last; i += step)
 	{
@@ -810,7 +840,7 @@ void MainWindow::downloadNextBatch()
 			url = m_urlFormat.arg(i, m_maskCount, 10, QChar('0'));
 		}
 
-		QString directory = directoryFromUrl(url);
+		QString directory = directoryFromUrl(batch.directory, url);
 
 		// create all intermediate directories
 		QDir().mkpath(directory);
@@ -838,11 +868,19 @@ void MainWindow::downloadNextBatch()
 		entry.filename = fileName;
 		entry.fullPath = fullPath;
 		entry.method = DownloadEntry::Method::Head; // download big files
+		entry.batch = batch.id;
+
+		for (const QPair<QString, int>& format : mirrorFormats)
+		{
+			entry.mirrors << (format.second > 0 ? format.first.arg(i, format.second, 10, QChar('0')) : format.first);
+		}
 
 		m_manager->addToQueue(entry);
+
+		++queued;
 	}
 
-	m_manager->start();
+	return queued;
 }
 
 void MainWindow::onQueueStarted(int total)
@@ -851,6 +889,9 @@ void MainWindow::onQueueStarted(int total)
 
 	m_progressTotal->setMaximum(total);
 
+	// record phases of all entries until the end of queue
+	Tracer::setEnabled(!m_settings.value("TraceFile").toString().isEmpty());
+
 #ifdef USE_TASKBAR
 		QWinTaskbarProgress* progress = m_button->progress();
 
@@ -864,6 +905,8 @@ void MainWindow::onQueueStarted(int total)
 
 void MainWindow::onQueueProgress(int current, int total)
 {
+	// total increases when next batches are queued
+	m_progressTotal->setMaximum(total);
 	m_progressTotal->setValue(current);
 
 #ifdef USE_TASKBAR
@@ -878,6 +921,10 @@ void MainWindow::onQueueProgress(int current, int total)
 
 void MainWindow::onQueueFinished(bool aborted)
 {
+	// next batches will be queued when read
+	if (!aborted && m_csvReading) return;
+
+	m_downloading = false;
 
 #ifdef USE_TASKBAR
 	QWinTaskbarProgress* progress = m_button->progress();
@@ -888,40 +935,90 @@ void MainWindow::onQueueFinished(bool aborted)
 	// TODO: for other OSes
 #endif
 
-	if (!aborted)
+	if (Tracer::isEnabled())
 	{
-		// remove current batch if any
-		if (!m_batches.isEmpty())
-		{
-			m_batches.removeFirst();
+		QString traceFile = m_settings.value("TraceFile").toString();
 
-			m_ui->urlsListView->model()->removeRow(0);
-		}
-
-		if (m_batches.isEmpty())
+		if (Tracer::save(traceFile))
 		{
-			restoreCurrent();
-
-			m_ui->downloadButton->setText(tr("Download"));
-
-			SystrayIcon::getInstance()->displayMessage(tr("BatchDownloader notification"), tr("All files have been downloded."), SystrayIcon::ActionNone);
-
+			printInfo(tr("Trace saved to %1").arg(traceFile));
 		}
 		else
 		{
-			downloadNextBatch();
+			printWarning(tr("Unable to save trace to %1").arg(traceFile));
 		}
+
+		// release events
+		Tracer::setEnabled(false);
+	}
+
+	DownloadStatistics statistics = m_manager->statistics();
+
+	if (statistics.elapsed > 0)
+	{
+		double seconds = (double)statistics.elapsed / 1000.0;
+		double mib = (double)statistics.bytes / (1024.0 * 1024.0);
+
+		// CPU needed to process 1 GiB, useful to compare versions
+		double cpuPerGib = statistics.bytes > 0 ? (double)statistics.cpuTime / 1000.0 * 1024.0 / mib : 0.0;
+
+		printInfo(tr("%1 file(s) in %2 s (%3 files/s), %4 MiB (%5 MiB/s), CPU %6 s (%7 s/GiB), peak memory %8 MiB")
+			.arg(statistics.files).arg(seconds, 0, 'f', 1).arg((double)statistics.files / seconds, 0, 'f', 1)
+			.arg(mib, 0, 'f', 1).arg(mib / seconds, 0, 'f', 2)
+			.arg((double)statistics.cpuTime / 1000.0, 0, 'f', 1).arg(cpuPerGib, 0, 'f', 1)
+			.arg((double)statistics.peakMemory / (1024.0 * 1024.0), 0, 'f', 1));
+	}
+
+	if (!aborted)
+	{
+		// batches without any file to download
+		m_batchesModel->clear();
+
+		m_ui->downloadButton->setText(tr("Download"));
+
+		SystrayIcon::getInstance()->displayMessage(tr("BatchDownloader notification"), tr("All files have been downloded."), SystrayIcon::ActionNone);
 	}
 	else
 	{
 		// don't delete batches when aborted
-		restoreCurrent();
-
 		m_ui->downloadButton->setText(tr("Download"));
 	}
 }
 
-void MainWindow::onDownloadStarted(const DownloadEntry& entry)
+void MainWindow::onBatchProgress(int batch, int done, int total)
+{
+	int row = m_batchesModel->rowFromId(batch);
+
+	if (row < 0) return;
+
+	Batch b = m_batchesModel->batch(row);
+
+	// also count entries not queued yet
+	int remaining = b.next > -1 && b.next <= b.last ? (b.last - b.next) / qMax(b.step, 1) + 1 : 0;
+
+	m_batchesModel->setProgress(batch, done, total + remaining);
+
+	// queue next entries before the last ones are downloaded, batch is not finished then
+	if (remaining > 0 && total - done < QUEUED_ENTRIES_PER_BATCH / 2) queueBatchEntries(row);
+}
+
+void MainWindow::onBatchFinished(int batch)
+{
+	// batches can finish in any order
+	int row = m_batchesModel->rowFromId(batch);
+
+	if (row > -1)
+	{
+		printSuccess(tr("All files of %1 have been downloaded").arg(m_batchesModel->url(row)));
+
+		m_batchesModel->remove(row);
+
+		// only queued batches can be finished
+		--m_nextBatch;
+	}
+}
+
+void MainWindow::onDownloadStarted(const DownloadEvent& entry)
 {
 	m_fileLabel->setText(entry.url);
 
@@ -935,60 +1032,59 @@ void MainWindow::onDownloadProgress(qint64 done, qint64 total, int speed)
 	m_speedLabel->setText(tr("%1 KiB/s").arg(speed));
 }
 
-void MainWindow::onDownloadSucceeded(const QByteArray& /* data */, const DownloadEntry& /* entry */)
+void MainWindow::onDownloadSucceeded(const QByteArray& /* data */, const DownloadEvent& /* entry */)
 {
 	printSuccess(tr("Download succeeded"));
 }
 
-void MainWindow::onDownloadSaved(const DownloadEntry& entry)
+void MainWindow::onDownloadSaved(const DownloadEvent& entry)
 {
+	m_batchesModel->addBytes(entry.batch, entry.filesize);
+
 	printSuccess(tr("File %1 saved").arg(entry.filename));
 }
 
-void MainWindow::onDownloadInfo(const QString& info, const DownloadEntry& /* entry */)
+void MainWindow::onDownloadInfo(const QString& info, const DownloadEvent& /* entry */)
 {
 	printInfo(info);
 }
 
-void MainWindow::onDownloadWarning(const QString& warning, const DownloadEntry& /* entry */)
+void MainWindow::onDownloadWarning(const QString& warning, const DownloadEvent& /* entry */)
 {
 	printWarning(warning);
 }
 
-void MainWindow::onDownloadError(const QString& error, const DownloadEntry& entry)
+void MainWindow::onDownloadError(const QString& error, const DownloadEvent& /* entry */)
 {
 	printError(error);
 
 	m_ui->downloadButton->setText(tr("Download"));
-
-	restoreCurrent();
 }
 
-void MainWindow::printLog(const QString &style, const QString &str)
+void MainWindow::onDownloadFailed(const DownloadEvent& entry)
 {
-	m_ui->logsTextEdit->append(QString("<div class='%1'>%2</div>").arg(style).arg(str));
-	m_ui->logsTextEdit->moveCursor(QTextCursor::End);
-	m_ui->logsTextEdit->ensureCursorVisible();
+	// errors followed by a successful retry are not counted
+	m_batchesModel->addError(entry.batch);
 }
 
 void MainWindow::printSuccess(const QString& str)
 {
-	printLog("success", str);
+	m_log->append(LogSink::Level::Success, str);
 }
 
 void MainWindow::printInfo(const QString &str)
 {
-	printLog("info", str);
+	m_log->append(LogSink::Level::Info, str);
 }
 
 void MainWindow::printWarning(const QString &str)
 {
-	printLog("warning", str);
+	m_log->append(LogSink::Level::Warning, str);
 }
 
 void MainWindow::printError(const QString &str)
 {
-	printLog("error", str);
+	m_log->append(LogSink::Level::Error, str);
 
 	SystrayIcon::getInstance()->displayMessage(tr("BatchDownloader notification"), tr("An error occured."), SystrayIcon::ActionNone);
 }
@@ -20,34 +20,24 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "batch.h"
+
 class QProgressBar;
 class QWinTaskbarButton;
 class DownloadManager;
 class Updater;
+class CsvReader;
+class BatchesModel;
+class LogSink;
+class MetricsExporter;
 
-struct DownloadEntry;
+struct DownloadEvent;
 
 namespace Ui
 {
 	class MainWindow;
 }
 
-struct Batch
-{
-	Batch():first(-1), last(-1), step(-1)
-	{
-	}
-
-	QString url;
-	QString referer;
-	int first;
-	int last;
-	int step;
-	QString directory;
-};
-
-typedef QVector<Batch> Batches;
-
 class MainWindow : public QMainWindow
 {
 	Q_OBJECT
@@ -80,38 +70,46 @@ public slots:
 	void onQueueProgress(int current, int total);
 	void onQueueFinished(bool aborted);
 
-	void onDownloadStarted(const DownloadEntry& entry);
+	void onBatchProgress(int batch, int done, int total);
+	void onBatchFinished(int batch);
+
+	void onBatchesRead(const Batches& batches);
+	void onCsvError(const QString& error);
+	void onCsvFinished();
+
+	void onDownloadStarted(const DownloadEvent& entry);
 	void onDownloadProgress(qint64 done, qint64 total, int speed);
-	void onDownloadSucceeded(const QByteArray& data, const DownloadEntry& entry);
-	void onDownloadSaved(const DownloadEntry& entry);
+	void onDownloadSucceeded(const QByteArray& data, const DownloadEvent& entry);
+	void onDownloadSaved(const DownloadEvent& entry);
 
-	void onDownloadInfo(const QString& info, const DownloadEntry& entry);
-	void onDownloadWarning(const QString& warning, const DownloadEntry& entry);
-	void onDownloadError(const QString& error, const DownloadEntry& entry);
+	void onDownloadInfo(const QString& info, const DownloadEvent& entry);
+	void onDownloadWarning(const QString& warning, const DownloadEvent& entry);
+	void onDownloadError(const QString& error, const DownloadEvent& entry);
+	void onDownloadFailed(const DownloadEvent& entry);
 
 protected:
 	void showEvent(QShowEvent *e);
 
-	void downloadNextBatch();
+	void downloadBatches();
+	void queueNextBatches();
+	void queueBatchEntries(int row);
+	int queueEntries(const Batch& batch, int first, int last);
 
-	QString directoryFromUrl(const QString &url);
+	QString directoryFromUrl(const QString &directory, const QString &url);
 	QString fileNameFromUrl(const QString &url, int currentFile);
 
 	bool loadSettings();
 	bool saveSettings();
 
-	void printLog(const QString &style, const QString &str);
 	void printSuccess(const QString& str);
 	void printInfo(const QString &str);
 	void printWarning(const QString &str);
 	void printError(const QString &str);
 
 	bool loadCSV(const QString& file);
+	void stopCSV();
 	bool saveCSV(const QString& file) const;
 
-	void saveCurrent();
-	void restoreCurrent();
-
 	Ui::MainWindow* m_ui;
 	DownloadManager* m_manager;
 
@@ -130,9 +128,15 @@ protected:
 
 	QWinTaskbarButton *m_button;
 
-	Batches m_batches;
+	BatchesModel *m_batchesModel;
+	int m_nextBatch; // first batch not registered in manager yet
+	bool m_downloading; // until all batches are downloaded or download is aborted
 
-	Batch m_current;
+	CsvReader *m_csvReader;
+	int m_csvGeneration; // incremented when an import is stopped
+	bool m_csvReading; // batches could still be read
+	LogSink *m_log;
+	MetricsExporter *m_metrics;
 };
 
 #endif
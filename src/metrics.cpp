@@ -0,0 +1,309 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "metrics.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// added to all names
+#define METRICS_PREFIX "batchdownloader_"
+
+// file is rewritten every 10 seconds
+#define DUMP_INTERVAL 10000
+
+// upper bounds of histograms buckets in seconds, +Inf is implicit
+static const double s_buckets[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0 };
+
+#define BUCKETS_COUNT (int)(sizeof(s_buckets) / sizeof(s_buckets[0]))
+
+struct Histogram
+{
+	Histogram():sum(0.0), count(0)
+	{
+		buckets.fill(0, BUCKETS_COUNT);
+	}
+
+	QVector<qint64> buckets; // not cumulative
+	double sum;
+	qint64 count;
+};
+
+struct Registry
+{
+	QAtomicInt enabled;
+	QMutex mutex;
+
+	// sorted by name so labels of a same metric are together
+	QMap<QString, qint64> counters;
+	QMap<QString, qint64> gauges;
+	QMap<QString, Histogram> histograms;
+};
+
+static Registry& registry()
+{
+	static Registry s_registry;
+
+	return s_registry;
+}
+
+void Metrics::setEnabled(bool enabled)
+{
+	registry().enabled.storeRelaxed(enabled ? 1 : 0);
+}
+
+bool Metrics::isEnabled()
+{
+	return registry().enabled.loadRelaxed() != 0;
+}
+
+void Metrics::increment(const char* name, qint64 value)
+{
+	if (!isEnabled()) return;
+
+	increment(QString::fromLatin1(name), value);
+}
+
+void Metrics::increment(const QString& name, qint64 value)
+{
+	Registry& r = registry();
+
+	if (!r.enabled.loadRelaxed()) return;
+
+	QMutexLocker locker(&r.mutex);
+
+	r.counters[name] += value;
+}
+
+void Metrics::setGauge(const char* name, qint64 value)
+{
+	Registry& r = registry();
+
+	if (!r.enabled.loadRelaxed()) return;
+
+	QMutexLocker locker(&r.mutex);
+
+	r.gauges[QString::fromLatin1(name)] = value;
+}
+
+void Metrics::observe(const char* name, double seconds)
+{
+	Registry& r = registry();
+
+	if (!r.enabled.loadRelaxed()) return;
+
+	QMutexLocker locker(&r.mutex);
+
+	Histogram& histogram = r.histograms[QString::fromLatin1(name)];
+
+	int i = 0;
+
+	while (i < BUCKETS_COUNT && seconds > s_buckets[i]) ++i;
+
+	// in +Inf bucket
+	if (i < BUCKETS_COUNT) ++histogram.buckets[i];
+
+	histogram.sum += seconds;
+	++histogram.count;
+}
+
+static QByteArray familyName(const QString& name)
+{
+	int pos = name.indexOf('{');
+
+	return (pos > -1 ? name.left(pos) : name).toUtf8();
+}
+
+static void appendValues(QByteArray& text, const QMap<QString, qint64>& values, const char* type)
+{
+	QByteArray lastFamily;
+
+	for (QMap<QString, qint64>::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+	{
+		QByteArray family = familyName(it.key());
+
+		// only once for all labels
+		if (family != lastFamily)
+		{
+			text += "# TYPE " METRICS_PREFIX + family + " " + type + "\n";
+
+			lastFamily = family;
+		}
+
+		text += METRICS_PREFIX + it.key().toUtf8() + " " + QByteArray::number(it.value()) + "\n";
+	}
+}
+
+QByteArray Metrics::toText()
+{
+	Registry& r = registry();
+
+	QMutexLocker locker(&r.mutex);
+
+	QByteArray text;
+
+	appendValues(text, r.counters, "counter");
+	appendValues(text, r.gauges, "gauge");
+
+	for (QMap<QString, Histogram>::const_iterator it = r.histograms.constBegin(); it != r.histograms.constEnd(); ++it)
+	{
+		QByteArray name = METRICS_PREFIX + it.key().toUtf8();
+		const Histogram& histogram = it.value();
+
+		text += "# TYPE " + name + " histogram\n";
+
+		qint64 count = 0;
+
+		for (int i = 0; i < BUCKETS_COUNT; ++i)
+		{
+			count += histogram.buckets[i];
+
+			text += name + "_bucket{le=\"" + QByteArray::number(s_buckets[i]) + "\"} " + QByteArray::number(count) + "\n";
+		}
+
+		text += name + "_bucket{le=\"+Inf\"} " + QByteArray::number(histogram.count) + "\n";
+		text += name + "_sum " + QByteArray::number(histogram.sum, 'f', 6) + "\n";
+		text += name + "_count " + QByteArray::number(histogram.count) + "\n";
+	}
+
+	return text;
+}
+
+MetricsExporter::MetricsExporter(QObject* parent):QObject(parent), m_server(nullptr)
+{
+	m_timer = new QTimer(this);
+	m_timer->setInterval(DUMP_INTERVAL);
+	connect(m_timer, &QTimer::timeout, this, &MetricsExporter::onDump);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	// last values
+	onDump();
+}
+
+bool MetricsExporter::listen(quint16 port)
+{
+	if (m_server)
+	{
+		if (m_server->serverPort() == port) return true;
+
+		delete m_server;
+		m_server = nullptr;
+	}
+
+	if (port == 0)
+	{
+		updateEnabled();
+
+		return true;
+	}
+
+	m_server = new QTcpServer(this);
+
+	connect(m_server, &QTcpServer::newConnection, this, &MetricsExporter::onNewConnection);
+
+	if (!m_server->listen(QHostAddress::LocalHost, port))
+	{
+		qWarning() << "Unable to listen on port" << port << m_server->errorString();
+
+		delete m_server;
+		m_server = nullptr;
+
+		updateEnabled();
+
+		return false;
+	}
+
+	updateEnabled();
+
+	return true;
+}
+
+void MetricsExporter::setFile(const QString& filename)
+{
+	m_filename = filename;
+
+	if (m_filename.isEmpty())
+	{
+		m_timer->stop();
+	}
+	else
+	{
+		m_timer->start();
+	}
+
+	updateEnabled();
+}
+
+void MetricsExporter::updateEnabled()
+{
+	// metrics are recorded only if they can be read
+	Metrics::setEnabled(m_server || !m_filename.isEmpty());
+}
+
+void MetricsExporter::onNewConnection()
+{
+	while (QTcpSocket* socket = m_server->nextPendingConnection())
+	{
+		connect(socket, &QTcpSocket::readyRead, this, &MetricsExporter::onReadyRead);
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+	}
+}
+
+void MetricsExporter::onReadyRead()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+
+	if (!socket) return;
+
+	// wait for the end of request headers, any path returns metrics
+	QByteArray request = socket->peek(socket->bytesAvailable());
+
+	if (!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+	{
+		// not an HTTP client
+		if (request.size() > 8192) socket->abort();
+
+		return;
+	}
+
+	socket->readAll();
+
+	QByteArray body = Metrics::toText();
+
+	socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n");
+	socket->write(body);
+	socket->disconnectFromHost();
+}
+
+void MetricsExporter::onDump()
+{
+	if (m_filename.isEmpty()) return;
+
+	// readers never see a partial file
+	QSaveFile file(m_filename);
+
+	if (!file.open(QFile::WriteOnly)) return;
+
+	file.write(Metrics::toText());
+	file.commit();
+}
@@ -0,0 +1,78 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+class QTcpServer;
+class QTimer;
+
+// registry of counters, gauges and histograms shared by all threads, names
+// can contain labels like responses_total{code="200"}, they are exported
+// with the Prometheus text format
+class Metrics
+{
+public:
+	// nothing is recorded while no exporter is configured
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+
+	// counters only increase, names are only converted when enabled
+	static void increment(const char* name, qint64 value = 1);
+	static void increment(const QString& name, qint64 value = 1);
+
+	// gauges are current values
+	static void setGauge(const char* name, qint64 value);
+
+	// add a duration in seconds to histogram
+	static void observe(const char* name, double seconds);
+
+	// Prometheus text format
+	static QByteArray toText();
+};
+
+// expose metrics on a local HTTP port and/or dump them periodically in a file
+class MetricsExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	MetricsExporter(QObject* parent);
+	virtual ~MetricsExporter();
+
+	// only listen on localhost, 0 to stop
+	bool listen(quint16 port);
+
+	// empty to disable
+	void setFile(const QString& filename);
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDump();
+
+private:
+	void updateEnabled();
+
+	QTcpServer *m_server;
+	QTimer *m_timer;
+	QString m_filename;
+};
+
+#endif
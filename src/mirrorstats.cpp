@@ -0,0 +1,269 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "mirrorstats.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// weight of new values in moving averages
+#define AVERAGE_WEIGHT 0.3
+
+// size used to compare mirrors, latency matters more for small files
+#define REFERENCE_SIZE (1024.0 * 1024.0)
+
+// each failure costs as much as a 10 seconds download
+#define FAILURE_PENALTY 10000.0
+
+// least recently used hosts are removed beyond this limit
+#define MAX_HOSTS 1000
+
+// hosts not used as mirrors since 90 days are removed
+#define MAX_HOST_AGE (90 * 24 * 3600)
+
+static double average(double previous, double value)
+{
+	return previous > 0.0 ? previous + (value - previous) * AVERAGE_WEIGHT : value;
+}
+
+static QString hostFromUrl(const QString& url)
+{
+	QUrl u(url);
+
+	// same host with different ports are different mirrors
+	return u.port() > -1 ? QString("%1:%2").arg(u.host()).arg(u.port()) : u.host();
+}
+
+MirrorStats::Host::Host():latency(0.0), throughput(0.0), failures(0.0), used(0)
+{
+}
+
+MirrorStats::MirrorStats():m_modified(false)
+{
+}
+
+MirrorStats::~MirrorStats()
+{
+	save();
+}
+
+bool MirrorStats::load(const QString& filename)
+{
+	m_filename = filename;
+	m_hosts.clear();
+	m_modified = false;
+
+	QFile file(filename);
+
+	if (!file.open(QFile::ReadOnly | QFile::Text)) return false;
+
+	qint64 oldest = QDateTime::currentSecsSinceEpoch() - MAX_HOST_AGE;
+
+	// one host per line: host latency throughput failures used
+	while (!file.atEnd())
+	{
+		QList<QByteArray> fields = file.readLine().trimmed().split(' ');
+
+		// hosts recorded without date were not always mirrors
+		if (fields.size() == 4) m_modified = true;
+
+		if (fields.size() != 5) continue;
+
+		qint64 used = fields[4].toLongLong();
+
+		if (used < oldest)
+		{
+			m_modified = true;
+			continue;
+		}
+
+		Host& h = m_hosts[QString::fromUtf8(fields[0])];
+		h.latency = fields[1].toDouble();
+		h.throughput = fields[2].toDouble();
+		h.failures = fields[3].toDouble();
+		h.used = used;
+	}
+
+	return true;
+}
+
+bool MirrorStats::save()
+{
+	if (!m_modified || m_filename.isEmpty()) return true;
+
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+
+	QSaveFile file(m_filename);
+
+	if (!file.open(QFile::WriteOnly | QFile::Text)) return false;
+
+	for (QHash<QString, Host>::const_iterator it = m_hosts.constBegin(); it != m_hosts.constEnd(); ++it)
+	{
+		const Host& h = it.value();
+
+		file.write(it.key().toUtf8() + " " + QByteArray::number(h.latency, 'f', 1) + " " + QByteArray::number(h.throughput, 'f', 0) + " " + QByteArray::number(h.failures, 'f', 2) + " " + QByteArray::number(h.used) + "\n");
+	}
+
+	if (!file.commit()) return false;
+
+	m_modified = false;
+
+	return true;
+}
+
+MirrorStats::Host* MirrorStats::host(const QString& url)
+{
+	if (m_hosts.isEmpty()) return nullptr;
+
+	QHash<QString, Host>::iterator it = m_hosts.find(hostFromUrl(url));
+
+	return it != m_hosts.end() ? &it.value() : nullptr;
+}
+
+void MirrorStats::addHost(const QString& url)
+{
+	QString name = hostFromUrl(url);
+
+	qint64 now = QDateTime::currentSecsSinceEpoch();
+
+	QHash<QString, Host>::iterator it = m_hosts.find(name);
+
+	if (it == m_hosts.end())
+	{
+		// too many hosts, forget the least recently used one
+		if (m_hosts.size() >= MAX_HOSTS)
+		{
+			QHash<QString, Host>::iterator oldest = m_hosts.begin();
+
+			for (QHash<QString, Host>::iterator it2 = m_hosts.begin(); it2 != m_hosts.end(); ++it2)
+			{
+				if (it2.value().used < oldest.value().used) oldest = it2;
+			}
+
+			m_hosts.erase(oldest);
+		}
+
+		it = m_hosts.insert(name, Host());
+	}
+
+	// only save it once a day if nothing else changed
+	if (now - it.value().used > 24 * 3600) m_modified = true;
+
+	it.value().used = now;
+}
+
+void MirrorStats::addLatency(const QString& url, qint64 ms)
+{
+	Host* h = host(url);
+
+	if (!h) return;
+
+	h->latency = average(h->latency, (double)qMax(ms, (qint64)1));
+	h->failures /= 2.0;
+
+	m_modified = true;
+}
+
+void MirrorStats::addThroughput(const QString& url, qint64 bytes, qint64 ms)
+{
+	// too small to measure a speed
+	if (bytes < 65536 || ms < 1) return;
+
+	Host* h = host(url);
+
+	if (!h) return;
+
+	h->throughput = average(h->throughput, (double)bytes * 1000.0 / (double)ms);
+	h->failures /= 2.0;
+
+	m_modified = true;
+}
+
+void MirrorStats::addFailure(const QString& url)
+{
+	Host* h = host(url);
+
+	if (!h) return;
+
+	h->failures += 1.0;
+
+	m_modified = true;
+}
+
+double MirrorStats::score(const QString& url) const
+{
+	QHash<QString, Host>::const_iterator it = m_hosts.constFind(hostFromUrl(url));
+
+	if (it == m_hosts.constEnd()) return 0.0;
+
+	const Host& h = it.value();
+
+	// expected time in ms to download a reference file
+	double time = h.latency;
+
+	if (h.throughput > 0.0) time += REFERENCE_SIZE * 1000.0 / h.throughput;
+
+	return time + h.failures * FAILURE_PENALTY;
+}
+
+QStringList MirrorStats::sort(const QStringList& urls)
+{
+	QVector<QPair<double, QString> > scores;
+	scores.reserve(urls.size());
+
+	for (const QString& url : urls)
+	{
+		scores << qMakePair(score(url), url);
+
+		addHost(url);
+	}
+
+	std::stable_sort(scores.begin(), scores.end(), [](const QPair<double, QString>& a, const QPair<double, QString>& b) { return a.first < b.first; });
+
+	QStringList res;
+
+	for (const QPair<double, QString>& score : scores)
+	{
+		res << score.second;
+	}
+
+	return res;
+}
+
+QString MirrorStats::best(const QStringList& urls) const
+{
+	QString res;
+	double bestScore = 0.0;
+
+	for (const QString& url : urls)
+	{
+		double s = score(url);
+
+		// equal ones keep their order
+		if (res.isEmpty() || s < bestScore)
+		{
+			res = url;
+			bestScore = s;
+		}
+	}
+
+	return res;
+}
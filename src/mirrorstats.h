@@ -0,0 +1,72 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MIRRORSTATS_H
+#define MIRRORSTATS_H
+
+// performance of each mirror host, kept between sessions to choose the
+// fastest mirror of a file before downloading it
+class MirrorStats
+{
+public:
+	MirrorStats();
+	~MirrorStats();
+
+	// load previous values, they are saved in the same file
+	bool load(const QString& filename);
+	bool save();
+
+	// only hosts of entries with mirrors are measured, other ones are ignored
+	// duration of a request without body
+	void addLatency(const QString& url, qint64 ms);
+
+	// body received at this speed
+	void addThroughput(const QString& url, qint64 bytes, qint64 ms);
+
+	void addFailure(const QString& url);
+
+	// URLs sorted by expected download time, unknown hosts are tried first
+	// to measure them and equal ones keep their order, all hosts are then measured
+	QStringList sort(const QStringList& urls);
+
+	// first URL of sort() without registering hosts
+	QString best(const QStringList& urls) const;
+
+private:
+	struct Host
+	{
+		Host();
+
+		double latency; // ms, 0 if unknown
+		double throughput; // bytes/s, 0 if unknown
+		double failures; // decreased after each success
+		qint64 used; // last time it was a mirror, in seconds since epoch
+	};
+
+	// nullptr if host is not a mirror
+	Host* host(const QString& url);
+	void addHost(const QString& url);
+	double score(const QString& url) const;
+
+	QHash<QString, Host> m_hosts;
+	QString m_filename;
+	bool m_modified;
+};
+
+#endif
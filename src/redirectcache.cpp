@@ -0,0 +1,259 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "redirectcache.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// limit memory used by a long session
+#define MAX_PERMANENT_REDIRECTS 10000
+#define MAX_RULES 100
+
+// a rewrite is applied to other URLs once it has been observed this number of times
+#define RULE_CONFIRMATIONS 2
+
+// maximum length of a chain of permanent redirections
+#define MAX_REDIRECTS 5
+
+RedirectCache::RedirectCache():m_modified(false)
+{
+}
+
+RedirectCache::~RedirectCache()
+{
+	save();
+}
+
+bool RedirectCache::load(const QString& filename)
+{
+	m_filename = filename;
+
+	clear();
+
+	if (m_filename.isEmpty()) return true;
+
+	QFile file(m_filename);
+
+	if (!file.open(QFile::ReadOnly | QFile::Text)) return false;
+
+	// "P from to" for permanent redirections and "R count from to" for rules
+	while (!file.atEnd())
+	{
+		QStringList fields = QString::fromUtf8(file.readLine()).trimmed().split(' ');
+
+		if (fields.size() == 3 && fields[0] == "P")
+		{
+			m_permanent[fields[1]] = fields[2];
+		}
+		else if (fields.size() == 4 && fields[0] == "R")
+		{
+			Rule rule;
+			rule.count = fields[1].toInt();
+			rule.fromPrefix = fields[2];
+			rule.toPrefix = fields[3];
+
+			m_rules << rule;
+		}
+	}
+
+	return true;
+}
+
+bool RedirectCache::save()
+{
+	if (!m_modified || m_filename.isEmpty()) return true;
+
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+
+	QSaveFile file(m_filename);
+
+	if (!file.open(QFile::WriteOnly | QFile::Text)) return false;
+
+	// URLs never contain spaces
+	for (QHash<QString, QString>::const_iterator it = m_permanent.constBegin(); it != m_permanent.constEnd(); ++it)
+	{
+		file.write("P " + it.key().toUtf8() + " " + it.value().toUtf8() + "\n");
+	}
+
+	for (const Rule& rule : m_rules)
+	{
+		file.write("R " + QByteArray::number(rule.count) + " " + rule.fromPrefix.toUtf8() + " " + rule.toPrefix.toUtf8() + "\n");
+	}
+
+	if (!file.commit()) return false;
+
+	m_modified = false;
+
+	return true;
+}
+
+void RedirectCache::clear()
+{
+	m_permanent.clear();
+	m_rules.clear();
+
+	m_modified = false;
+}
+
+void RedirectCache::add(const QString& from, const QString& to, int statusCode)
+{
+	if (from.isEmpty() || to.isEmpty() || from == to) return;
+
+	// temporary redirections (302, 303 and 307) can change at any time
+	if (statusCode != 301 && statusCode != 308) return;
+
+	// same URL will always be redirected
+	if (m_permanent.size() < MAX_PERMANENT_REDIRECTS)
+	{
+		m_permanent[from] = to;
+
+		m_modified = true;
+	}
+
+	// signed URLs and different parameters can't be guessed for other files
+	if (from.contains('?') || to.contains('?')) return;
+
+	// prefixes contain at least scheme and host
+	int fromScheme = from.indexOf("://");
+	int fromHostEnd = fromScheme > -1 ? from.indexOf('/', fromScheme + 3) : -1;
+
+	int toScheme = to.indexOf("://");
+	int toHostEnd = toScheme > -1 ? to.indexOf('/', toScheme + 3) : -1;
+
+	if (fromHostEnd < 0 || toHostEnd < 0) return;
+
+	// common end of both URLs
+	int len = 0;
+
+	while (len < from.length() && len < to.length() && from[from.length() - len - 1] == to[to.length() - len - 1]) ++len;
+
+	// start rule at a path separator in common part
+	int slash = qMax(from.length() - len, fromHostEnd);
+
+	while (slash < from.length() && from[slash] != '/') ++slash;
+
+	// filename is different
+	if (slash >= from.length()) return;
+
+	int toSlash = to.length() - (from.length() - slash);
+
+	if (toSlash < toHostEnd) return;
+
+	QString fromPrefix = from.left(slash);
+	QString toPrefix = to.left(toSlash);
+
+	for (Rule& rule : m_rules)
+	{
+		if (rule.fromPrefix == fromPrefix && rule.toPrefix == toPrefix)
+		{
+			++rule.count;
+
+			m_modified = true;
+
+			return;
+		}
+	}
+
+	if (m_rules.size() >= MAX_RULES) return;
+
+	Rule rule;
+	rule.fromPrefix = fromPrefix;
+	rule.toPrefix = toPrefix;
+	rule.count = 1;
+
+	m_rules << rule;
+
+	m_modified = true;
+}
+
+bool RedirectCache::findRule(const QString& url, QString* fromPrefix, QString* toPrefix, bool onlyConfirmed) const
+{
+	int best = -1;
+
+	// longest prefix is the most specific
+	for (int i = 0; i < m_rules.size(); ++i)
+	{
+		const Rule& rule = m_rules[i];
+
+		if (onlyConfirmed && rule.count < RULE_CONFIRMATIONS) continue;
+
+		if (url.length() > rule.fromPrefix.length() && url.startsWith(rule.fromPrefix) && url[rule.fromPrefix.length()] == '/')
+		{
+			if (best < 0 || rule.fromPrefix.length() > m_rules[best].fromPrefix.length()) best = i;
+		}
+	}
+
+	if (best < 0) return false;
+
+	if (fromPrefix) *fromPrefix = m_rules[best].fromPrefix;
+	if (toPrefix) *toPrefix = m_rules[best].toPrefix;
+
+	return true;
+}
+
+QString RedirectCache::resolve(const QString& url) const
+{
+	QString res = url;
+
+	// follow chains
+	for (int i = 0; i < MAX_REDIRECTS; ++i)
+	{
+		QHash<QString, QString>::const_iterator it = m_permanent.constFind(res);
+
+		if (it == m_permanent.constEnd()) break;
+
+		res = it.value();
+	}
+
+	// rules are not learned from URLs with parameters, don't apply them either
+	if (res == url && !url.contains('?'))
+	{
+		QString fromPrefix, toPrefix;
+
+		if (!findRule(url, &fromPrefix, &toPrefix, true)) return QString();
+
+		res = toPrefix + url.mid(fromPrefix.length());
+	}
+
+	return res == url ? QString() : res;
+}
+
+void RedirectCache::invalidate(const QString& url)
+{
+	if (m_permanent.remove(url) > 0) m_modified = true;
+
+	QString fromPrefix, toPrefix;
+
+	if (!findRule(url, &fromPrefix, &toPrefix, false)) return;
+
+	for (int i = 0; i < m_rules.size(); ++i)
+	{
+		if (m_rules[i].fromPrefix == fromPrefix && m_rules[i].toPrefix == toPrefix)
+		{
+			m_rules.remove(i);
+
+			m_modified = true;
+
+			break;
+		}
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REDIRECTCACHE_H
+#define REDIRECTCACHE_H
+
+// remember permanent redirections (301 and 308) to request final locations
+// directly, they are used for the same URL and rewrites of a same prefix
+// observed several times are used for other URLs without parameters
+class RedirectCache
+{
+public:
+	RedirectCache();
+	~RedirectCache();
+
+	// only kept in memory if filename is empty
+	bool load(const QString& filename);
+	bool save();
+
+	void add(const QString& from, const QString& to, int statusCode);
+
+	// final location or empty string if unknown
+	QString resolve(const QString& url) const;
+
+	// cached location failed, forget redirections used for this URL
+	void invalidate(const QString& url);
+
+	void clear();
+
+private:
+	struct Rule
+	{
+		QString fromPrefix;
+		QString toPrefix;
+		int count; // number of times it was observed
+	};
+
+	bool findRule(const QString& url, QString* fromPrefix, QString* toPrefix, bool onlyConfirmed) const;
+
+	QHash<QString, QString> m_permanent;
+	QVector<Rule> m_rules;
+	QString m_filename;
+	bool m_modified;
+};
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "requesttemplate.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// encode an item name with the same rules as the whole query
+static QByteArray encodeQueryItemName(const QString& name)
+{
+	QUrlQuery query;
+	query.addQueryItem(name, "0");
+
+	// remove the value
+	QByteArray res = query.query().toUtf8();
+	res.chop(1);
+
+	return res;
+}
+
+RequestTemplate::RequestTemplate(const DownloadEntry& entry, const QByteArray& userAgent):m_method(entry.method), m_headers(entry.headers), m_parameters(entry.parameters),
+	m_offsetParameter(entry.offsetParameter), m_countParameter(entry.countParameter), m_data(entry.data), m_referer(entry.referer), m_rawPostData(false)
+{
+	// set referer header
+	if (!m_referer.isEmpty()) m_request.setRawHeader("Referer", m_referer.toLatin1());
+
+	// user agent is always global
+	if (!userAgent.isEmpty()) m_request.setRawHeader("User-Agent", userAgent);
+
+	if (m_headers.contains("Accept"))
+	{
+		// custom Accept value
+		m_request.setRawHeader("Accept", m_headers["Accept"].toLatin1());
+	}
+	else
+	{
+		// default Accept value
+		m_request.setRawHeader("Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+	}
+
+	m_request.setRawHeader("Accept-Language", "fr-FR,fr;q=0.9,en-US;q=0.8,en;q=0.7");
+
+	// append custom headers
+	QMap<QString, QString>::ConstIterator it = m_headers.constBegin(), iend = m_headers.constEnd();
+
+	while (it != iend)
+	{
+		// Accept already processed before
+		if (it.key() != "Accept") m_request.setRawHeader(it.key().toUtf8(), it.value().toUtf8());
+
+		++it;
+	}
+
+	if (m_method == DownloadEntry::Method::Post)
+	{
+		if (m_headers.contains("Content-Type") && !m_data.isEmpty())
+		{
+			// send data as is
+			m_rawPostData = true;
+			m_postData = m_data.toUtf8();
+		}
+		else
+		{
+			// required
+			m_request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded; charset=UTF-8");
+
+			QUrlQuery params;
+
+			// reset iterators
+			it = m_parameters.constBegin();
+			iend = m_parameters.constEnd();
+
+			while (it != iend)
+			{
+				params.addQueryItem(it.key(), it.value());
+
+				++it;
+			}
+
+			m_postData = params.query().toUtf8();
+
+			if (!m_offsetParameter.isEmpty()) m_postOffsetItem = encodeQueryItemName(m_offsetParameter);
+			if (!m_countParameter.isEmpty()) m_postCountItem = encodeQueryItemName(m_countParameter);
+		}
+	}
+	else
+	{
+		// reset iterators
+		it = m_parameters.constBegin();
+		iend = m_parameters.constEnd();
+
+		while (it != iend)
+		{
+			// and ampersand if existing parameters
+			if (!m_query.isEmpty()) m_query += "&";
+
+			m_query += it.key() + "=" + it.value();
+
+			++it;
+		}
+
+		if (!m_offsetParameter.isEmpty()) m_offsetItem = m_offsetParameter + "=";
+		if (!m_countParameter.isEmpty()) m_countItem = m_countParameter + "=";
+	}
+}
+
+RequestTemplate::~RequestTemplate()
+{
+}
+
+bool RequestTemplate::matches(const DownloadEntry& entry) const
+{
+	// HEAD and GET requests are identical, entries switch from one to the other
+	bool post = entry.method == DownloadEntry::Method::Post;
+
+	if (post != (m_method == DownloadEntry::Method::Post)) return false;
+
+	// entries of a same batch share the same data, so comparisons are fast
+	return m_headers == entry.headers && m_parameters == entry.parameters &&
+		m_offsetParameter == entry.offsetParameter && m_countParameter == entry.countParameter && m_data == entry.data;
+}
+
+QNetworkRequest RequestTemplate::request(const DownloadEntry& entry) const
+{
+	QNetworkRequest request(m_request);
+
+	if (entry.referer != m_referer)
+	{
+		// a null value removes the header
+		request.setRawHeader("Referer", entry.referer.isEmpty() ? QByteArray() : entry.referer.toLatin1());
+	}
+
+	return request;
+}
+
+QString RequestTemplate::query(const QString& urlQuery, const DownloadEntry& entry) const
+{
+	QString query = urlQuery;
+
+	if (!m_query.isEmpty())
+	{
+		// and ampersand if existing parameters
+		if (!query.isEmpty()) query += "&";
+
+		query += m_query;
+	}
+
+	// append offset
+	if (!m_offsetItem.isEmpty())
+	{
+		// and ampersand if existing parameters
+		if (!query.isEmpty()) query += "&";
+
+		query += m_offsetItem + QString::number(entry.offset);
+	}
+
+	// append count
+	if (!m_countItem.isEmpty())
+	{
+		// and ampersand if existing parameters
+		if (!query.isEmpty()) query += "&";
+
+		query += m_countItem + QString::number(entry.count);
+	}
+
+	return query;
+}
+
+QByteArray RequestTemplate::postData(const DownloadEntry& entry) const
+{
+	if (m_rawPostData) return m_postData;
+
+	QByteArray data = m_postData;
+
+	// append offset
+	if (!m_postOffsetItem.isEmpty())
+	{
+		if (!data.isEmpty()) data += "&";
+
+		data += m_postOffsetItem + QByteArray::number(entry.offset);
+	}
+
+	// append count
+	if (!m_postCountItem.isEmpty())
+	{
+		if (!data.isEmpty()) data += "&";
+
+		data += m_postCountItem + QByteArray::number(entry.count);
+	}
+
+	return data;
+}
@@ -0,0 +1,67 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REQUESTTEMPLATE_H
+#define REQUESTTEMPLATE_H
+
+#include "downloadentry.h"
+
+// request built once for all entries of a same batch, headers and parameters
+// are already encoded, only URL, referer, offset and count change for each entry
+class RequestTemplate
+{
+public:
+	RequestTemplate(const DownloadEntry& entry, const QByteArray& userAgent);
+	~RequestTemplate();
+
+	// true if entry shares the same fields
+	bool matches(const DownloadEntry& entry) const;
+
+	// request with all headers, URL is not set
+	QNetworkRequest request(const DownloadEntry& entry) const;
+
+	// query for GET and HEAD methods
+	QString query(const QString& urlQuery, const DownloadEntry& entry) const;
+
+	// data for POST method
+	QByteArray postData(const DownloadEntry& entry) const;
+
+private:
+	QNetworkRequest m_request;
+
+	// fields used to build it
+	DownloadEntry::Method m_method;
+	QMap<QString, QString> m_headers;
+	QMap<QString, QString> m_parameters;
+	QString m_offsetParameter;
+	QString m_countParameter;
+	QString m_data;
+	QString m_referer;
+
+	// already encoded
+	QString m_query;
+	QString m_offsetItem;
+	QString m_countItem;
+	QByteArray m_postData;
+	QByteArray m_postOffsetItem;
+	QByteArray m_postCountItem;
+	bool m_rawPostData;
+};
+
+#endif
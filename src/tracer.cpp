@@ -0,0 +1,186 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common.h"
+#include "tracer.h"
+
+#ifdef DEBUG_NEW
+#define new DEBUG_NEW
+#endif
+
+// about 24 MiB, next events are dropped
+#define MAX_TRACE_EVENTS 1000000
+
+struct TraceEvent
+{
+	qint64 timestamp; // in us
+	int id;
+	char phase; // B, E or i
+	const char* name; // always a literal
+};
+
+struct Trace
+{
+	Trace():dropped(0)
+	{
+	}
+
+	QMutex mutex;
+	QAtomicInt enabled;
+	QElapsedTimer timer;
+	QVector<TraceEvent> events;
+	QHash<int, QString> names;
+	int dropped;
+};
+
+static Trace& trace()
+{
+	static Trace s_trace;
+
+	return s_trace;
+}
+
+static void addEvent(int id, char phase, const char* name)
+{
+	Trace& t = trace();
+
+	// only an atomic read when disabled
+	if (!t.enabled.loadRelaxed()) return;
+
+	QMutexLocker locker(&t.mutex);
+
+	if (t.events.size() >= MAX_TRACE_EVENTS)
+	{
+		++t.dropped;
+		return;
+	}
+
+	TraceEvent event;
+	event.timestamp = t.timer.nsecsElapsed() / 1000;
+	event.id = id;
+	event.phase = phase;
+	event.name = name;
+
+	t.events << event;
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+	Trace& t = trace();
+
+	QMutexLocker locker(&t.mutex);
+
+	t.events.clear();
+	t.names.clear();
+	t.dropped = 0;
+
+	if (enabled) t.timer.start();
+
+	t.enabled.storeRelaxed(enabled ? 1 : 0);
+}
+
+bool Tracer::isEnabled()
+{
+	return trace().enabled.loadRelaxed() != 0;
+}
+
+void Tracer::setName(int id, const QString& name)
+{
+	Trace& t = trace();
+
+	if (!t.enabled.loadRelaxed()) return;
+
+	QMutexLocker locker(&t.mutex);
+
+	t.names[id] = name;
+}
+
+void Tracer::begin(int id, const char* name)
+{
+	addEvent(id, 'B', name);
+}
+
+void Tracer::end(int id)
+{
+	addEvent(id, 'E', "");
+}
+
+void Tracer::instant(int id, const char* name)
+{
+	addEvent(id, 'i', name);
+}
+
+static QByteArray jsonString(const QString& str)
+{
+	// QJsonDocument only accepts arrays and objects, remove brackets
+	QByteArray json = QJsonDocument(QJsonArray() << str).toJson(QJsonDocument::Compact);
+
+	return json.mid(1, json.size() - 2);
+}
+
+bool Tracer::save(const QString& filename)
+{
+	Trace& t = trace();
+
+	QMutexLocker locker(&t.mutex);
+
+	QSaveFile file(filename);
+
+	if (!file.open(QFile::WriteOnly)) return false;
+
+	// written by blocks to not keep the whole JSON in memory
+	QByteArray data = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+
+	for (QHash<int, QString>::const_iterator it = t.names.constBegin(); it != t.names.constEnd(); ++it)
+	{
+		if (!first) data += ",\n";
+
+		data += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + QByteArray::number(it.key()) + ",\"args\":{\"name\":" + jsonString(it.value()) + "}}";
+
+		first = false;
+	}
+
+	for (const TraceEvent& event : t.events)
+	{
+		if (!first) data += ",\n";
+
+		data += "{\"ph\":\"" + QByteArray(1, event.phase) + "\",\"name\":\"" + event.name + "\",\"pid\":1,\"tid\":" + QByteArray::number(event.id) + ",\"ts\":" + QByteArray::number(event.timestamp);
+
+		// instant events are only drawn on their line
+		if (event.phase == 'i') data += ",\"s\":\"t\"";
+
+		data += "}";
+
+		first = false;
+
+		if (data.size() > 1024 * 1024)
+		{
+			file.write(data);
+			data.clear();
+		}
+	}
+
+	data += "\n],\"otherData\":{\"droppedEvents\":" + QByteArray::number(t.dropped) + "}}\n";
+
+	file.write(data);
+
+	return file.commit();
+}
@@ -0,0 +1,45 @@
+/*
+ *  BatchDownloader is a tool to download URLs
+ *  Copyright (C) 2013-2021  Cedric OCHS
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+// timestamps phases of each entry, events are kept in memory while enabled
+// and saved with the Chrome trace event format which is also read by
+// Perfetto, each entry is displayed on its own line
+class Tracer
+{
+public:
+	// previous events are discarded
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+
+	// label of the line of entry
+	static void setName(int id, const QString& name);
+
+	// duration events of a same entry are nested
+	static void begin(int id, const char* name);
+	static void end(int id);
+
+	static void instant(int id, const char* name);
+
+	static bool save(const QString& filename);
+};
+
+#endif
@@ -94,7 +94,7 @@ QString decodeEntities(const QString& src)
 	initSpecialEntities();
 
 	QString ret(src);
-	QRegularExpression re("&#([0-9]+);");
+	static const QRegularExpression re("&#([0-9]+);");
 
 	QRegularExpressionMatchIterator it = re.globalMatch(src);
 
@@ -57,4 +57,14 @@ QString convertIDOToDate(const QString &date);
 QString base36enc(qint64 value);
 QColor average(const QColor &color1, const QColor &color2, qreal coef);
 
+// CPU time used by process in ms, user + system
+qint64 getProcessCpuTime();
+
+// maximum memory used by process since its start in bytes
+qint64 getPeakMemoryUsage();
+
+// GUI processes have no console under Windows, write stdout and stderr to
+// console of parent process if they are not redirected
+bool attachConsole();
+
 #endif
@@ -23,6 +23,7 @@
 #ifdef Q_OS_MAC
 
 #include <Carbon/Carbon.h>
+#include <sys/resource.h>
 
 void mouseLeftClickUp(const QPoint& pos)
 {
@@ -144,4 +145,29 @@ bool IsOS64bits()
 	return true;
 }
 
+qint64 getProcessCpuTime()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+	return (qint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+qint64 getPeakMemoryUsage()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+	// in bytes under macOS
+	return (qint64)usage.ru_maxrss;
+}
+
+bool attachConsole()
+{
+	// stdout is always available
+	return true;
+}
+
 #endif
@@ -37,6 +37,7 @@ QPixmap qt_pixmapFromWinHBITMAP(HBITMAP bitmap, int hbitmapFormat = 0);
 #include <stdio.h>
 #include <ShellAPI.h>
 #include <sdkddkver.h>
+#include <psapi.h>
 
 #ifdef DEBUG_NEW
 #define new DEBUG_NEW
@@ -581,4 +582,60 @@ bool IsOS64bits()
 	return res;
 }
 
+static qint64 fileTimeToMs(const FILETIME& time)
+{
+	ULARGE_INTEGER value;
+	value.LowPart = time.dwLowDateTime;
+	value.HighPart = time.dwHighDateTime;
+
+	// in 100 ns units
+	return (qint64)(value.QuadPart / 10000);
+}
+
+qint64 getProcessCpuTime()
+{
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) return 0;
+
+	return fileTimeToMs(kernelTime) + fileTimeToMs(userTime);
+}
+
+typedef BOOL (WINAPI *GetProcessMemoryInfoPtr)(HANDLE Process, PPROCESS_MEMORY_COUNTERS ppsmemCounters, DWORD cb);
+
+static GetProcessMemoryInfoPtr pGetProcessMemoryInfo = NULL;
+
+qint64 getPeakMemoryUsage()
+{
+	// in kernel32 since Windows 7, avoid to link to psapi
+	if (pGetProcessMemoryInfo == NULL)
+	{
+		pGetProcessMemoryInfo = (GetProcessMemoryInfoPtr) QLibrary::resolve("kernel32", "K32GetProcessMemoryInfo");
+
+		if (pGetProcessMemoryInfo == NULL) pGetProcessMemoryInfo = (GetProcessMemoryInfoPtr) QLibrary::resolve("psapi", "GetProcessMemoryInfo");
+
+		if (pGetProcessMemoryInfo == NULL) return 0;
+	}
+
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (!pGetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+
+	return (qint64)counters.PeakWorkingSetSize;
+}
+
+bool attachConsole()
+{
+	HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	// already redirected to a file or a pipe
+	if (handle != NULL && handle != INVALID_HANDLE_VALUE) return true;
+
+	if (!AttachConsole(ATTACH_PARENT_PROCESS)) return false;
+
+	FILE *file = NULL;
+
+	return freopen_s(&file, "CONOUT$", "w", stdout) == 0 && freopen_s(&file, "CONOUT$", "w", stderr) == 0;
+}
+
 #endif
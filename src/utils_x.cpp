@@ -30,6 +30,7 @@
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <X11/Xmu/WinUtil.h>
+#include <sys/resource.h>
 
 #ifdef index
 	#undef index
@@ -181,4 +182,29 @@ bool EndSystemProgress()
 	return false;
 }
 
+qint64 getProcessCpuTime()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+	return (qint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+qint64 getPeakMemoryUsage()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+	// in kiB under Linux
+	return (qint64)usage.ru_maxrss * 1024;
+}
+
+bool attachConsole()
+{
+	// stdout is always available
+	return true;
+}
+
 #endif